@@ -0,0 +1,69 @@
+/**
+ * @file bench_denormal.c
+ * @brief Denormal slowdown of a recurrence kernel, with and without defer_fp_fast
+ *
+ * Each element follows x = x * decay + bias. With a normal bias the values
+ * settle at normal magnitudes; with a tiny bias they settle in the denormal
+ * range, where most x86 cores take a microcode assist per operation. Inside
+ * defer_fp_fast() denormal inputs and results are flushed to zero, so the
+ * kernel runs at the normal speed again.
+ *
+ * Usage: bench_denormal [passes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define DEFER_IMPLEMENTATION
+#include "../defer.h"
+
+#define ELEMENTS 4096
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Returns nanoseconds per element update
+static double kernel(float* values, float bias, int passes) {
+    volatile float decay_source = 0.5f;
+    float decay = decay_source;
+    for (int i = 0; i < ELEMENTS; i++) {
+        values[i] = bias;
+    }
+    double start = now_sec();
+    for (int pass = 0; pass < passes; pass++) {
+        for (int i = 0; i < ELEMENTS; i++) {
+            values[i] = values[i] * decay + bias;
+        }
+    }
+    return (now_sec() - start) * 1e9 / ((double)passes * ELEMENTS);
+}
+
+int main(int argc, char** argv) {
+    int passes = argc > 1 ? atoi(argv[1]) : 20000;
+    float* values = malloc(ELEMENTS * sizeof(float));
+    if (!values) {
+        return 1;
+    }
+    defer(free, values);
+
+    volatile float normal = 1e-20f, denormal = 1e-40f;
+    printf("%-28s %10s %14s\n", "case", "ns/elem", "last value");
+    double base = kernel(values, normal, passes);
+    printf("%-28s %10.3f %14g\n", "normal", base, values[0]);
+    double slow = kernel(values, denormal, passes);
+    printf("%-28s %10.3f %14g\n", "denormal", slow, values[0]);
+    double fast;
+    {
+        defer_fp_fast();
+        fast = kernel(values, denormal, passes);
+    }
+    printf("%-28s %10.3f %14g\n", "denormal in defer_fp_fast", fast, values[0]);
+    double after = kernel(values, denormal, passes);
+    printf("%-28s %10.3f %14g\n", "denormal after the scope", after, values[0]);
+    printf("slowdown %.1fx without the scope, %.1fx inside it\n", slow / base, fast / base);
+    return 0;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file bench_fsync.c
+ * @brief Commits per second of per-thread fsync versus defer_fsync group commit
+ *
+ * Every thread appends a small record to its own file and makes it durable,
+ * either with a plain fsync() at scope exit or through defer_fsync(). The
+ * thread count doubles from 1 to 64.
+ *
+ * Usage: bench_fsync [dir] [seconds_per_step] [window_us]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define DEFER_IMPLEMENTATION
+#include "../defer.h"
+
+#define MAX_THREADS 64
+
+typedef struct {
+    const char* dir;
+    int index;
+    int grouped;
+    volatile int* stop;
+    unsigned long commits;
+} worker_t;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void close_fd(void* arg) {
+    close(*(int*)arg);
+}
+
+static void remove_file(void* path) {
+    remove((const char*)path);
+}
+
+static void plain_fsync(void* arg) {
+    fsync(*(int*)arg);
+}
+
+static void* worker_thread(void* arg) {
+    worker_t* worker = (worker_t*)arg;
+    char path[512];
+    snprintf(path, sizeof(path), "%s/bench_fsync_%d.log", worker->dir, worker->index);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    defer(remove_file, path);
+    defer(close_fd, &fd);
+
+    char record[128];
+    memset(record, 'r', sizeof(record));
+    while (!*worker->stop) {
+        if (worker->grouped) {
+            defer_fsync(fd);
+            if (write(fd, record, sizeof(record)) != (ssize_t)sizeof(record)) {
+                break;
+            }
+        } else {
+            defer(plain_fsync, &fd);
+            if (write(fd, record, sizeof(record)) != (ssize_t)sizeof(record)) {
+                break;
+            }
+        }
+        worker->commits++;
+    }
+    return NULL;
+}
+
+static double run_step(const char* dir, int threads, int grouped, double seconds) {
+    worker_t workers[MAX_THREADS];
+    pthread_t ids[MAX_THREADS];
+    volatile int stop = 0;
+
+    for (int i = 0; i < threads; i++) {
+        workers[i] = (worker_t){ dir, i, grouped, &stop, 0 };
+        pthread_create(&ids[i], NULL, worker_thread, &workers[i]);
+    }
+    double start = now_sec();
+    struct timespec ts = { (time_t)seconds, (long)((seconds - (double)(time_t)seconds) * 1e9) };
+    nanosleep(&ts, NULL);
+    stop = 1;
+
+    unsigned long commits = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+        commits += workers[i].commits;
+    }
+    return (double)commits / (now_sec() - start);
+}
+
+int main(int argc, char** argv) {
+    const char* dir = argc > 1 ? argv[1] : "build";
+    double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+    long window_us = argc > 3 ? atol(argv[3]) : 0;
+
+    defer_fsync_config(window_us, 1);
+    printf("Directory %s, %.1fs per step, group window %ld us\n", dir, seconds, window_us);
+    printf("%8s %16s %16s %8s\n", "threads", "fsync/s", "defer_fsync/s", "speedup");
+    for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+        double plain = run_step(dir, threads, 0, seconds);
+        double grouped = run_step(dir, threads, 1, seconds);
+        printf("%8d %16.0f %16.0f %7.2fx\n", threads, plain, grouped, grouped / plain);
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+/**
+ * @file bench_jitter.c
+ * @brief Latency jitter of a fixed workload with and without defer_pin_cpu
+ *
+ * A measuring thread repeats a small fixed computation and records how long
+ * each repetition takes, while one noise thread per CPU alternates busy work
+ * and short sleeps. The run is repeated unpinned, pinned with defer_pin_cpu,
+ * pinned under SCHED_FIFO and pinned with defer_mlockall; modes that need
+ * privileges are reported as skipped when refused.
+ *
+ * Usage: bench_jitter [seconds_per_mode]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#define DEFER_IMPLEMENTATION
+#include "../defer.h"
+
+#define MAX_NOISE 256
+#define BUCKETS 100000  // 100 ns each; the last also counts anything slower
+
+typedef struct {
+    volatile int* stop;
+    int cpu;
+} noise_t;
+
+static volatile uint64_t sink;  // Keeps the workload from being optimized out
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t workload(uint64_t seed) {
+    for (int i = 0; i < 2000; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+    }
+    return seed;
+}
+
+static void* noise_main(void* arg) {
+    noise_t* noise = (noise_t*)arg;
+    defer_pin_cpu(noise->cpu);
+    uint64_t seed = (uint64_t)noise->cpu + 1;
+    while (!*noise->stop) {
+        uint64_t until = now_ns() + 2000000;
+        while (now_ns() < until) {
+            seed = workload(seed);
+        }
+        struct timespec ts = { 0, 500000 };
+        nanosleep(&ts, NULL);
+    }
+    sink = seed;
+    return NULL;
+}
+
+static double percentile(const uint32_t* histogram, uint64_t total, double fraction) {
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += histogram[i];
+        if ((double)seen >= fraction * (double)total) {
+            return (double)(i + 1) / 10.0;
+        }
+    }
+    return (double)BUCKETS / 10.0;
+}
+
+static void measure(const char* name, double seconds, uint32_t* histogram) {
+    memset(histogram, 0, BUCKETS * sizeof(uint32_t));
+    uint64_t total = 0, worst = 0, seed = 88172645463325252ULL;
+    uint64_t end = now_ns() + (uint64_t)(seconds * 1e9);
+    for (uint64_t start = now_ns(); start < end; total++) {
+        seed = workload(seed);
+        uint64_t stop = now_ns();
+        uint64_t ns = stop - start;
+        histogram[ns / 100 < BUCKETS ? ns / 100 : BUCKETS - 1]++;
+        worst = ns > worst ? ns : worst;
+        start = stop;
+    }
+    sink = seed;
+    printf("%-18s %10.1f %10.1f %10.1f %10.1f\n", name,
+           percentile(histogram, total, 0.5), percentile(histogram, total, 0.99),
+           percentile(histogram, total, 0.999), (double)worst / 1e3);
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int noise_count = cpus > 0 && cpus <= MAX_NOISE ? (int)cpus : 1;
+    int target = noise_count - 1;  // Measure on the last CPU
+
+    uint32_t* histogram = malloc(BUCKETS * sizeof(uint32_t));
+    if (!histogram) {
+        return 1;
+    }
+    defer(free, histogram);
+
+    noise_t noise[MAX_NOISE];
+    pthread_t tids[MAX_NOISE];
+    volatile int stop = 0;
+    for (int i = 0; i < noise_count; i++) {
+        noise[i] = (noise_t){ &stop, i };
+        pthread_create(&tids[i], NULL, noise_main, &noise[i]);
+    }
+
+    printf("%d noise threads, measuring on CPU %d for %.0fs per mode\n", noise_count, target, seconds);
+    printf("%-18s %10s %10s %10s %10s\n", "mode", "p50 us", "p99 us", "p999 us", "max us");
+    measure("unpinned", seconds, histogram);
+    {
+        int status;
+        defer_pin_cpu_status(target, &status);
+        if (status != 0) {
+            printf("%-18s skipped: %s\n", "pinned", strerror(status));
+        } else {
+            measure("pinned", seconds, histogram);
+        }
+    }
+    {
+        int pinned, fifo;
+        defer_pin_cpu_status(target, &pinned);
+        defer_sched_status(SCHED_FIFO, 1, &fifo);
+        if (pinned != 0 || fifo != 0) {
+            printf("%-18s skipped: %s\n", "pinned+fifo", strerror(pinned ? pinned : fifo));
+        } else {
+            measure("pinned+fifo", seconds, histogram);
+        }
+    }
+    {
+        int pinned, locked;
+        defer_pin_cpu_status(target, &pinned);
+        defer_mlockall_status(MCL_CURRENT | MCL_FUTURE, &locked);
+        if (pinned != 0 || locked != 0) {
+            printf("%-18s skipped: %s\n", "pinned+mlockall", strerror(pinned ? pinned : locked));
+        } else {
+            measure("pinned+mlockall", seconds, histogram);
+        }
+    }
+
+    stop = 1;
+    for (int i = 0; i < noise_count; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    return 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file bench_mlock.c
+ * @brief Page faults and access latency of a working buffer under memory pressure, with and without defer_mlock
+ *
+ * The working buffer is a file mapping, so the kernel can evict it under
+ * pressure even without swap. Each round reads one byte per page of the
+ * buffer and records the major and minor faults it took and how long it
+ * ran. Between rounds the buffer is pushed out of memory, either by
+ * MADV_PAGEOUT (the default, a local stand-in for reclaim) or by a forked
+ * memory hog that keeps touching hog_megabytes of anonymous memory; run the
+ * hog inside a memory-limited cgroup for realistic pressure. Locked pages
+ * are never reclaimed, so inside defer_mlock every round should take zero
+ * major faults.
+ *
+ * Usage: bench_mlock [buffer_megabytes] [rounds] [hog_megabytes] [dir]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#define DEFER_IMPLEMENTATION
+#include "../defer.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static volatile uint64_t sink;  // Keeps the reads from being optimized out
+
+// Pushes the buffer out of memory one page at a time; locked pages refuse
+static void page_out(char* buf, size_t bytes, size_t page) {
+#ifdef MADV_PAGEOUT
+    for (size_t off = 0; off < bytes; off += page) {
+        madvise(buf + off, page, MADV_PAGEOUT);
+    }
+#else
+    (void)buf;
+    (void)bytes;
+    (void)page;
+#endif
+}
+
+static void cleanup_hog(void* ptr) {
+    pid_t pid = *(pid_t*)ptr;
+    if (pid > 0) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+    }
+}
+
+// Child that keeps touching `megabytes` of anonymous memory
+static pid_t start_hog(size_t megabytes, size_t page) {
+    pid_t pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+    size_t bytes = megabytes << 20;
+    char* hog = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (hog == MAP_FAILED) {
+        _exit(1);
+    }
+    for (unsigned char pass = 1;; pass++) {
+        for (size_t off = 0; off < bytes; off += page) {
+            hog[off] = (char)pass;
+        }
+    }
+}
+
+static void run(const char* name, char* buf, size_t bytes, size_t page, int rounds, int pageout) {
+    long majors = 0, minors = 0;
+    double worst = 0.0, total = 0.0;
+    uint64_t sum = 0;
+    for (int round = 0; round < rounds; round++) {
+        if (pageout) {
+            page_out(buf, bytes, page);
+        } else {
+            struct timespec ts = { 0, 200000000 };  // Give the hog time to evict
+            nanosleep(&ts, NULL);
+        }
+        struct rusage before, after;
+        getrusage(RUSAGE_SELF, &before);
+        double start = now_sec();
+        for (size_t off = 0; off < bytes; off += page) {
+            sum += (unsigned char)buf[off];
+        }
+        double elapsed = now_sec() - start;
+        getrusage(RUSAGE_SELF, &after);
+        majors += after.ru_majflt - before.ru_majflt;
+        minors += after.ru_minflt - before.ru_minflt;
+        total += elapsed;
+        worst = elapsed > worst ? elapsed : worst;
+    }
+    sink = sum;
+    printf("%-14s %14.1f %14.1f %12.2f %12.2f\n", name, (double)majors / rounds,
+           (double)minors / rounds, total * 1e3 / rounds, worst * 1e3);
+}
+
+int main(int argc, char** argv) {
+    size_t megabytes = argc > 1 ? (size_t)atol(argv[1]) : 4;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+    size_t hog_megabytes = argc > 3 ? (size_t)atol(argv[3]) : 0;
+    const char* dir = argc > 4 ? argv[4] : "build";
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t bytes = megabytes << 20;
+
+    // The soft RLIMIT_MEMLOCK may be raised up to the hard one without privileges
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_MEMLOCK, &limit);
+    }
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/bench_mlock.XXXXXX", dir);
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    defer_close(&fd);
+    unlink(path);
+    if (ftruncate(fd, (off_t)bytes) != 0) {
+        perror("ftruncate");
+        return 1;
+    }
+    char* buf = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (buf == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    defer_alloc_t mapping = { buf, bytes, DEFER_ALLOC_PAGES };
+    defer(cleanup_alloc, &mapping);
+    madvise(buf, bytes, MADV_RANDOM);  // One major fault per evicted page, not per readahead window
+    for (size_t off = 0; off < bytes; off += page) {
+        buf[off] = (char)off;
+    }
+    msync(buf, bytes, MS_SYNC);  // Clean pages can be dropped without writeback
+
+    pid_t hog = hog_megabytes > 0 ? start_hog(hog_megabytes, page) : -1;
+    defer(cleanup_hog, &hog);
+    int pageout = hog_megabytes == 0;
+#ifndef MADV_PAGEOUT
+    if (pageout) {
+        printf("MADV_PAGEOUT is unavailable; pass hog_megabytes to apply pressure\n");
+    }
+#endif
+    printf("%zu MiB file-backed buffer, %d rounds, pressure from %s\n", megabytes, rounds,
+           pageout ? "MADV_PAGEOUT" : "a memory hog");
+    printf("%-14s %14s %14s %12s %12s\n", "mode", "major/round", "minor/round", "avg ms", "max ms");
+    run("unlocked", buf, bytes, page, rounds, pageout);
+    {
+        int status;
+        defer_mlock_status(buf, bytes, &status);
+        if (status != 0) {
+            printf("%-14s skipped: %s (RLIMIT_MEMLOCK is %lld KiB)\n", "defer_mlock", strerror(status),
+                   limit.rlim_cur == RLIM_INFINITY ? -1LL : (long long)limit.rlim_cur / 1024);
+        } else {
+            run("defer_mlock", buf, bytes, page, rounds, pageout);
+        }
+    }
+    return 0;
+}
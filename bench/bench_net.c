@@ -0,0 +1,169 @@
+/**
+ * @file bench_net.c
+ * @brief Closed-loop load generator for example/epoll_server.c
+ *
+ * Each thread owns one connection and alternates SET and GET requests,
+ * waiting for every reply before sending the next request. Reports requests
+ * per second and p50/p99/p999 request latency. make bench-net runs it first
+ * against the server built with -DEPOLL_SERVER_MANUAL (explicit cleanup) and
+ * then against the defer build, so the two results compare directly.
+ *
+ * Usage: bench_net <port> [connections] [seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define DEFER_IMPLEMENTATION
+#include "../defer.h"
+
+#define MAX_CONNECTIONS 256
+
+typedef struct {
+    int port;
+    int index;
+    volatile int* stop;
+    uint64_t* samples;  // Latency in nanoseconds
+    size_t count;
+    size_t capacity;
+    int failed;
+} client_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int record(client_t* client, uint64_t latency) {
+    if (client->count == client->capacity) {
+        size_t capacity = client->capacity ? client->capacity * 2 : 65536;
+        uint64_t* samples = realloc(client->samples, capacity * sizeof(uint64_t));
+        if (!samples) {
+            return -1;
+        }
+        client->samples = samples;
+        client->capacity = capacity;
+    }
+    client->samples[client->count++] = latency;
+    return 0;
+}
+
+static void* client_thread(void* arg) {
+    client_t* client = (client_t*)arg;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        client->failed = 1;
+        return NULL;
+    }
+    defer_close(&fd);
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)client->port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        client->failed = 1;
+        return NULL;
+    }
+
+    char request[128], reply[512];
+    for (unsigned long i = 0; !*client->stop; i++) {
+        int len = (i & 1) ? snprintf(request, sizeof(request), "GET key%d_%lu\n", client->index, (i / 2) % 1000)
+                          : snprintf(request, sizeof(request), "SET key%d_%lu value%lu\n", client->index, (i / 2) % 1000, i);
+        uint64_t start = now_ns();
+        if (send(fd, request, (size_t)len, 0) != len) {
+            client->failed = 1;
+            return NULL;
+        }
+        // Replies are single lines; read until the newline arrives
+        size_t got = 0;
+        while (got == 0 || reply[got - 1] != '\n') {
+            ssize_t n = recv(fd, reply + got, sizeof(reply) - got, 0);
+            if (n <= 0 || got + (size_t)n >= sizeof(reply)) {
+                client->failed = 1;
+                return NULL;
+            }
+            got += (size_t)n;
+        }
+        if (record(client, now_ns() - start) != 0) {
+            client->failed = 1;
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: %s <port> [connections] [seconds]\n", argv[0]);
+        return 1;
+    }
+    int port = atoi(argv[1]);
+    int connections = argc > 2 ? atoi(argv[2]) : 8;
+    double seconds = argc > 3 ? atof(argv[3]) : 3.0;
+    if (connections < 1 || connections > MAX_CONNECTIONS) {
+        printf("Connections must be between 1 and %d\n", MAX_CONNECTIONS);
+        return 1;
+    }
+
+    client_t clients[MAX_CONNECTIONS];
+    pthread_t threads[MAX_CONNECTIONS];
+    volatile int stop = 0;
+    for (int i = 0; i < connections; i++) {
+        clients[i] = (client_t){ port, i, &stop, NULL, 0, 0, 0 };
+        pthread_create(&threads[i], NULL, client_thread, &clients[i]);
+    }
+
+    uint64_t start = now_ns();
+    struct timespec ts = { (time_t)seconds, (long)((seconds - (double)(time_t)seconds) * 1e9) };
+    nanosleep(&ts, NULL);
+    stop = 1;
+
+    size_t total = 0;
+    int failed = 0;
+    for (int i = 0; i < connections; i++) {
+        pthread_join(threads[i], NULL);
+        total += clients[i].count;
+        failed |= clients[i].failed;
+    }
+    double elapsed = (double)(now_ns() - start) / 1e9;
+
+    uint64_t* all = malloc((total ? total : 1) * sizeof(uint64_t));
+    if (!all) {
+        return 1;
+    }
+    defer(free, all);
+    size_t offset = 0;
+    for (int i = 0; i < connections; i++) {
+        memcpy(all + offset, clients[i].samples, clients[i].count * sizeof(uint64_t));
+        offset += clients[i].count;
+        free(clients[i].samples);
+    }
+    if (total == 0) {
+        printf("No requests completed\n");
+        return 1;
+    }
+    qsort(all, total, sizeof(uint64_t), compare_u64);
+
+    printf("connections %d, %.1fs, %zu requests\n", connections, elapsed, total);
+    printf("throughput  %.0f req/s\n", (double)total / elapsed);
+    printf("latency     p50 %.1f us  p99 %.1f us  p999 %.1f us\n",
+           (double)all[total / 2] / 1e3, (double)all[total * 99 / 100] / 1e3, (double)all[total * 999 / 1000] / 1e3);
+    return failed ? 1 : 0;
+}
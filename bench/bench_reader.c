@@ -0,0 +1,207 @@
+/**
+ * @file bench_reader.c
+ * @brief Page-cache impact of stdio scans versus defer_reader_t scans
+ *
+ * A background thread keeps hitting a small "hot" file with random preads
+ * while the main thread scans a large cold file, once through stdio and
+ * once through defer_reader_t. After each scan the page-cache residency of
+ * both files is sampled with mincore().
+ *
+ * Usage: bench_reader [scan_mb] [hot_mb] [dir]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define DEFER_IMPLEMENTATION
+#include "../defer.h"
+
+typedef struct {
+    const char* path;
+    size_t size;
+    volatile int stop;
+    unsigned long ops;
+} hot_workload_t;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void close_fd(void* arg) {
+    close(*(int*)arg);
+}
+
+static void remove_file(void* path) {
+    remove((const char*)path);
+}
+
+static int create_file(const char* path, size_t size) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    defer(close_fd, &fd);
+
+    char* block = malloc(1 << 20);
+    if (!block) {
+        return -1;
+    }
+    defer_free(block);
+    memset(block, 'x', 1 << 20);
+
+    for (size_t done = 0; done < size; done += 1 << 20) {
+        if (write(fd, block, 1 << 20) != 1 << 20) {
+            return -1;
+        }
+    }
+    fdatasync(fd);
+    return 0;
+}
+
+static void drop_cache(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    defer(close_fd, &fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+// Percentage of the file's pages currently in the page cache
+static double resident_percent(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1.0;
+    }
+    defer(close_fd, &fd);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        return -1.0;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return -1.0;
+    }
+
+    long page = sysconf(_SC_PAGESIZE);
+    size_t pages = ((size_t)st.st_size + (size_t)page - 1) / (size_t)page;
+    unsigned char* vec = malloc(pages);
+    size_t resident = 0;
+    if (vec && mincore(map, (size_t)st.st_size, vec) == 0) {
+        for (size_t i = 0; i < pages; i++) {
+            resident += vec[i] & 1;
+        }
+    }
+    free(vec);
+    munmap(map, (size_t)st.st_size);
+    return 100.0 * (double)resident / (double)pages;
+}
+
+static void* hot_thread(void* arg) {
+    hot_workload_t* hot = (hot_workload_t*)arg;
+    int fd = open(hot->path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    defer(close_fd, &fd);
+
+    char buf[4096];
+    uint64_t state = 88172645463325252ULL;
+    size_t blocks = hot->size / sizeof(buf);
+    while (!hot->stop) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        if (pread(fd, buf, sizeof(buf), (off_t)((state % blocks) * sizeof(buf))) > 0) {
+            hot->ops++;
+        }
+    }
+    return NULL;
+}
+
+static size_t scan_stdio(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+    defer_fclose(file);
+
+    char* buf = malloc(DEFER_READER_BUFSIZE);
+    if (!buf) {
+        return 0;
+    }
+    defer_free(buf);
+
+    size_t total = 0, n;
+    while ((n = fread(buf, 1, DEFER_READER_BUFSIZE, file)) > 0) {
+        total += n;
+    }
+    return total;
+}
+
+static size_t scan_reader(const char* path, int flags) {
+    defer_reader_t reader;
+    if (defer_reader_open(&reader, path, 0, flags) != 0) {
+        return 0;
+    }
+    defer_reader(&reader);
+
+    const void* chunk;
+    ssize_t n;
+    size_t total = 0;
+    while ((n = defer_reader_next(&reader, &chunk)) > 0) {
+        total += (size_t)n;
+    }
+    return total;
+}
+
+static void run_mode(const char* name, const char* scan_path, hot_workload_t* hot, int mode) {
+    drop_cache(scan_path);
+    hot->stop = 0;
+    hot->ops = 0;
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, hot_thread, hot);
+    double start = now_sec();
+    size_t bytes = mode == 0 ? scan_stdio(scan_path) : scan_reader(scan_path, mode == 2 ? DEFER_READER_DIRECT : 0);
+    double elapsed = now_sec() - start;
+    hot->stop = 1;
+    pthread_join(thread, NULL);
+
+    printf("%-16s %8.1f MB/s %12.0f hot ops/s %8.1f%% scan cached %8.1f%% hot cached\n",
+           name, (double)bytes / elapsed / 1e6, (double)hot->ops / elapsed,
+           resident_percent(scan_path), resident_percent(hot->path));
+}
+
+int main(int argc, char** argv) {
+    size_t scan_mb = argc > 1 ? (size_t)atol(argv[1]) : 256;
+    size_t hot_mb = argc > 2 ? (size_t)atol(argv[2]) : 32;
+    const char* dir = argc > 3 ? argv[3] : "build";
+
+    char scan_path[512], hot_path[512];
+    snprintf(scan_path, sizeof(scan_path), "%s/bench_reader_scan.bin", dir);
+    snprintf(hot_path, sizeof(hot_path), "%s/bench_reader_hot.bin", dir);
+
+    if (create_file(scan_path, scan_mb << 20) != 0 || create_file(hot_path, hot_mb << 20) != 0) {
+        printf("Failed to create benchmark files in %s\n", dir);
+        return 1;
+    }
+    defer(remove_file, scan_path);
+    defer(remove_file, hot_path);
+
+    hot_workload_t hot = { hot_path, hot_mb << 20, 0, 0 };
+    printf("Scanning %zu MB while a %zu MB hot set is read concurrently\n", scan_mb, hot_mb);
+    run_mode("stdio", scan_path, &hot, 0);
+    run_mode("defer_reader", scan_path, &hot, 1);
+    run_mode("defer_reader+dio", scan_path, &hot, 2);
+    return 0;
+}
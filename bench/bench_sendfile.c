@@ -0,0 +1,151 @@
+/**
+ * @file bench_sendfile.c
+ * @brief Loopback throughput of defer_sendfile versus read/write copying
+ *
+ * A receiver thread drains a loopback TCP connection while the main thread
+ * sends the same file repeatedly, first with a read()/write() copy loop and
+ * then with defer_sendfile().
+ *
+ * Usage: bench_sendfile [total_mb] [dir]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define DEFER_IMPLEMENTATION
+#include "../defer.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void remove_file(void* path) {
+    remove((const char*)path);
+}
+
+static void* drain_thread(void* arg) {
+    int fd = *(int*)arg;
+    char* buf = malloc(1 << 20);
+    if (!buf) {
+        return NULL;
+    }
+    defer(free, buf);
+    while (read(fd, buf, 1 << 20) > 0) {
+    }
+    return NULL;
+}
+
+static int create_file(const char* path, size_t size) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return -1;
+    }
+    defer_fclose(file);
+    for (size_t i = 0; i < size; i++) {
+        fputc((int)(i & 0xff), file);
+    }
+    return 0;
+}
+
+static ssize_t copy_file(int out_fd, const char* path) {
+    int in_fd = open(path, O_RDONLY);
+    if (in_fd < 0) {
+        return -1;
+    }
+    defer_close(&in_fd);
+
+    static char buf[65536];
+    ssize_t total = 0, n;
+    while ((n = read(in_fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t done = 0; done < n;) {
+            ssize_t w = write(out_fd, buf + done, (size_t)(n - done));
+            if (w <= 0) {
+                return -1;
+            }
+            done += w;
+        }
+        total += n;
+    }
+    return total;
+}
+
+// Connected loopback TCP pair; the receiving end is drained by a thread
+static int connect_loopback(int* out_fd, int* in_fd) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        return -1;
+    }
+    defer_close(&listener);
+
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 1) != 0 ||
+        getsockname(listener, (struct sockaddr*)&addr, &addr_len) != 0) {
+        return -1;
+    }
+
+    *out_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (*out_fd < 0 || connect(*out_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        return -1;
+    }
+    *in_fd = accept(listener, NULL, NULL);
+    return *in_fd < 0 ? -1 : 0;
+}
+
+static double run(const char* path, size_t file_size, size_t total, int zero_copy) {
+    int out_fd = -1, in_fd = -1;
+    if (connect_loopback(&out_fd, &in_fd) != 0) {
+        return 0.0;
+    }
+    defer_close(&in_fd);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, drain_thread, &in_fd);
+
+    size_t rounds = total / file_size ? total / file_size : 1;
+    double start = now_sec();
+    for (size_t i = 0; i < rounds; i++) {
+        ssize_t n = zero_copy ? defer_sendfile(out_fd, path, 0, 0) : copy_file(out_fd, path);
+        if (n != (ssize_t)file_size) {
+            printf("Transfer failed\n");
+            break;
+        }
+    }
+    double elapsed = now_sec() - start;
+    close(out_fd);
+    pthread_join(thread, NULL);
+    return (double)(rounds * file_size) / elapsed / 1e6;
+}
+
+int main(int argc, char** argv) {
+    size_t total = (argc > 1 ? (size_t)atol(argv[1]) : 512) << 20;
+    const char* dir = argc > 2 ? argv[2] : "build";
+    size_t sizes[] = { 4 << 10, 64 << 10, 1 << 20, 16 << 20 };
+
+    printf("%10s %16s %16s %8s\n", "file size", "read/write MB/s", "sendfile MB/s", "speedup");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/bench_sendfile_%zu.bin", dir, sizes[i]);
+        if (create_file(path, sizes[i]) != 0) {
+            printf("Failed to create %s\n", path);
+            return 1;
+        }
+        defer(remove_file, path);
+
+        double copy = run(path, sizes[i], total, 0);
+        double zero = run(path, sizes[i], total, 1);
+        printf("%9zuK %16.1f %16.1f %7.2fx\n", sizes[i] >> 10, copy, zero, zero / copy);
+    }
+    return 0;
+}
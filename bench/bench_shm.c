@@ -0,0 +1,153 @@
+/**
+ * @file bench_shm.c
+ * @brief Message passing between two processes: SPSC ring in defer_shm vs socketpair
+ *
+ * A forked consumer receives fixed-size messages and sums one byte per cache
+ * line of each. Over the ring the producer writes the message in place and
+ * the consumer reads it in place; over a Unix-domain socketpair every
+ * message is copied into the kernel and back out. Both sides spin with
+ * sched_yield() when the ring is full or empty.
+ *
+ * Usage: bench_shm [megabytes_per_size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define DEFER_IMPLEMENTATION
+#include "../defer.h"
+
+#define RING_BYTES (4 << 20)
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint64_t touch(const unsigned char* data, size_t len) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < len; i += 64) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+static int ring_consumer(defer_ring_t* ring, long count) {
+    uint64_t sum = 0;
+    for (long i = 0; i < count; i++) {
+        const void* data;
+        size_t len;
+        while ((data = defer_ring_peek(ring, &len)) == NULL) {
+            sched_yield();
+        }
+        sum += touch((const unsigned char*)data, len);
+        defer_ring_release(ring);
+    }
+    return sum == 0;
+}
+
+static double run_ring(size_t size, long count) {
+    defer_shm_t shm;
+    if (defer_shm_create(&shm, NULL, defer_ring_bytes(RING_BYTES)) != 0) {
+        return -1.0;
+    }
+    defer_shm(&shm);
+    defer_ring_t* ring = defer_ring_init(shm.addr, shm.size);
+    if (!ring) {
+        return -1.0;
+    }
+
+    double start = now_sec();
+    pid_t pid = fork();
+    if (pid == 0) {
+        _exit(ring_consumer(ring, count));
+    }
+    for (long i = 0; i < count; i++) {
+        void* slot;
+        while ((slot = defer_ring_reserve(ring, size)) == NULL) {
+            sched_yield();
+        }
+        memset(slot, (int)(i | 1), size);
+        defer_ring_commit(ring);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? now_sec() - start : -1.0;
+}
+
+static int read_full(int fd, unsigned char* buf, size_t len) {
+    for (size_t got = 0; got < len;) {
+        ssize_t n = read(fd, buf + got, len - got);
+        if (n <= 0) {
+            return -1;
+        }
+        got += (size_t)n;
+    }
+    return 0;
+}
+
+static double run_socket(size_t size, long count) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        return -1.0;
+    }
+    defer_close(&fds[0]);
+    defer_close(&fds[1]);
+    unsigned char* buf = malloc(size);
+    if (!buf) {
+        return -1.0;
+    }
+    defer(free, buf);
+
+    double start = now_sec();
+    pid_t pid = fork();
+    if (pid == 0) {
+        uint64_t sum = 0;
+        for (long i = 0; i < count; i++) {
+            if (read_full(fds[1], buf, size) != 0) {
+                _exit(1);
+            }
+            sum += touch(buf, size);
+        }
+        _exit(sum == 0);
+    }
+    for (long i = 0; i < count; i++) {
+        memset(buf, (int)(i | 1), size);
+        for (size_t sent = 0; sent < size;) {
+            ssize_t n = write(fds[0], buf + sent, size - sent);
+            if (n <= 0) {
+                return -1.0;
+            }
+            sent += (size_t)n;
+        }
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? now_sec() - start : -1.0;
+}
+
+int main(int argc, char** argv) {
+    long megabytes = argc > 1 ? atol(argv[1]) : 512;
+    size_t sizes[] = { 64, 1024, 16384, 262144 };
+    printf("%10s %16s %12s %16s %12s\n", "msg bytes", "ring msgs/s", "ring MB/s", "socket msgs/s", "socket MB/s");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        long count = (long)((size_t)megabytes * 1048576 / sizes[i]);
+        double ring = run_ring(sizes[i], count);
+        double sock = run_socket(sizes[i], count);
+        if (ring < 0 || sock < 0) {
+            printf("%10zu failed\n", sizes[i]);
+            return 1;
+        }
+        printf("%10zu %16.0f %12.0f %16.0f %12.0f\n", sizes[i],
+               (double)count / ring, (double)count * (double)sizes[i] / ring / 1e6,
+               (double)count / sock, (double)count * (double)sizes[i] / sock / 1e6);
+    }
+    return 0;
+}
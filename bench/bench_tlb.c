@@ -0,0 +1,190 @@
+/**
+ * @file bench_tlb.c
+ * @brief Random lookups in a large hash table on regular pages vs defer_alloc_huge
+ *
+ * The table is an open-addressing array of 16-byte slots, filled to half its
+ * capacity and then probed with random keys, so nearly every lookup touches
+ * a new page. On 4 KiB pages most lookups also miss the data TLB and walk
+ * the page tables; with 2 MiB pages the same table needs 512 times fewer TLB
+ * entries. The baseline maps the table with MADV_NOHUGEPAGE; the second run
+ * uses whatever path defer_alloc_huge took. dTLB load misses are read with
+ * perf_event_open when the kernel allows it.
+ *
+ * Usage: bench_tlb [table_megabytes] [lookups_millions]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#define DEFER_IMPLEMENTATION
+#include "../defer.h"
+
+typedef struct {
+    uint64_t key;
+    uint64_t value;
+} slot_t;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Returns a dTLB read-miss counter, or -1 when perf events are unavailable
+static int open_tlb_counter(void) {
+#if defined(__linux__)
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static void counter_start(int fd) {
+#if defined(__linux__)
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#else
+    (void)fd;
+#endif
+}
+
+static long long counter_stop(int fd) {
+    long long count = -1;
+#if defined(__linux__)
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+            count = -1;
+        }
+    }
+#else
+    (void)fd;
+#endif
+    return count;
+}
+
+// Kilobytes of anonymous memory backed by transparent huge pages
+static long thp_kb(void) {
+    FILE* smaps = fopen("/proc/self/smaps_rollup", "r");
+    if (!smaps) {
+        return -1;
+    }
+    defer_fclose(smaps);
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), smaps)) {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) {
+            break;
+        }
+    }
+    return kb;
+}
+
+static void fill(slot_t* table, size_t slots) {
+    size_t mask = slots - 1;
+    for (uint64_t i = 1; i <= slots / 2; i++) {
+        uint64_t key = mix(i);
+        size_t at = key & mask;
+        while (table[at].key) {
+            at = (at + 1) & mask;
+        }
+        table[at].key = key;
+        table[at].value = i;
+    }
+}
+
+static void run(const char* name, slot_t* table, size_t slots, long lookups, int counter) {
+    size_t mask = slots - 1;
+    fill(table, slots);
+    uint64_t sum = 0, state = 88172645463325252ULL;
+    counter_start(counter);
+    double start = now_sec();
+    for (long n = 0; n < lookups; n++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        uint64_t key = mix(state % (slots / 2) + 1);
+        for (size_t at = key & mask; table[at].key; at = (at + 1) & mask) {
+            if (table[at].key == key) {
+                sum += table[at].value;
+                break;
+            }
+        }
+    }
+    double elapsed = now_sec() - start;
+    long long misses = counter_stop(counter);
+    char miss_text[32] = "n/a";
+    if (misses >= 0) {
+        snprintf(miss_text, sizeof(miss_text), "%.3f", (double)misses / (double)lookups);
+    }
+    printf("%-24s %12.1f %14s %12ld  (sum %llu)\n", name, elapsed * 1e9 / (double)lookups,
+           miss_text, thp_kb(), (unsigned long long)sum);
+}
+
+int main(int argc, char** argv) {
+    size_t megabytes = argc > 1 ? (size_t)atol(argv[1]) : 1024;
+    long lookups = (long)((argc > 2 ? atof(argv[2]) : 20.0) * 1e6);
+    size_t slots = 1;
+    while (slots * 2 * sizeof(slot_t) <= megabytes << 20) {
+        slots *= 2;
+    }
+    size_t bytes = slots * sizeof(slot_t);
+    int counter = open_tlb_counter();
+    if (counter >= 0) {
+        defer_close(&counter);
+    }
+
+    printf("%zu MiB table, %zu slots, %ld random lookups\n", bytes >> 20, slots, lookups);
+    printf("%-24s %12s %14s %12s\n", "pages", "ns/lookup", "dTLB miss/op", "THP KB");
+    {
+        void* mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            perror("mmap");
+            return 1;
+        }
+        defer_alloc_t regular = { mem, bytes, DEFER_ALLOC_PAGES };
+        defer(cleanup_alloc, &regular);
+#ifdef MADV_NOHUGEPAGE
+        madvise(mem, bytes, MADV_NOHUGEPAGE);
+#endif
+        run("regular (nohugepage)", (slot_t*)mem, slots, lookups, counter);
+    }
+    {
+        defer_alloc_t huge;
+        slot_t* table = defer_alloc_huge(&huge, bytes);
+        if (!table) {
+            perror("defer_alloc_huge");
+            return 1;
+        }
+        const char* kinds[] = { "none", "aligned", "defer_alloc_huge hugetlb",
+                                "defer_alloc_huge thp", "defer_alloc_huge pages" };
+        run(kinds[huge.kind], table, slots, lookups, counter);
+    }
+    return 0;
+}
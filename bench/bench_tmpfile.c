@@ -0,0 +1,109 @@
+/**
+ * @file bench_tmpfile.c
+ * @brief Scoped spill files: named file plus remove() versus defer_tmpfile
+ *
+ * Each iteration creates a spill file, writes a block and discards it. The
+ * baseline opens a named file and removes it at scope exit, as the tests do
+ * with remove_wrapper; defer_tmpfile uses an unnamed O_TMPFILE descriptor
+ * that disappears on close. A third case creates a temp directory holding a
+ * few files and removes it with defer_tmpdir.
+ *
+ * Usage: bench_tmpfile [iterations] [dir]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFER_IMPLEMENTATION
+#include "../defer.h"
+
+#define BLOCK 4096
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void remove_path(void* path) {
+    remove((const char*)path);
+}
+
+static int named_spill(const char* dir, long i, const char* block) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/bench_spill_%ld.tmp", dir, i);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+    defer(remove_path, path);
+    defer_close(&fd);
+    return write(fd, block, BLOCK) == BLOCK ? 0 : -1;
+}
+
+static int anonymous_spill(const char* dir, const char* block) {
+    int fd;
+    defer_tmpfile(&fd, dir);
+    if (fd < 0) {
+        return -1;
+    }
+    return write(fd, block, BLOCK) == BLOCK ? 0 : -1;
+}
+
+static int spill_dir(const char* dir, const char* block) {
+    defer_tmpdir_t tmp;
+    defer_tmpdir(&tmp, dir);
+    if (tmp.fd < 0) {
+        return -1;
+    }
+    const char* names[] = { "run0", "run1", "run2", "index" };
+    for (int i = 0; i < 4; i++) {
+        int fd = openat(tmp.fd, names[i], O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            return -1;
+        }
+        defer_close(&fd);
+        if (write(fd, block, BLOCK) != BLOCK) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 20000;
+    const char* dir = argc > 2 ? argv[2] : "build";
+    char block[BLOCK];
+    memset(block, 'x', sizeof(block));
+
+    printf("%-32s %12s\n", "case", "files/s");
+    double start = now_sec();
+    for (long i = 0; i < iterations; i++) {
+        if (named_spill(dir, i, block) != 0) {
+            printf("named file failed\n");
+            return 1;
+        }
+    }
+    printf("%-32s %12.0f\n", "open + remove", (double)iterations / (now_sec() - start));
+
+    start = now_sec();
+    for (long i = 0; i < iterations; i++) {
+        if (anonymous_spill(dir, block) != 0) {
+            printf("defer_tmpfile failed\n");
+            return 1;
+        }
+    }
+    printf("%-32s %12.0f\n", "defer_tmpfile", (double)iterations / (now_sec() - start));
+
+    start = now_sec();
+    for (long i = 0; i < iterations / 4; i++) {
+        if (spill_dir(dir, block) != 0) {
+            printf("defer_tmpdir failed\n");
+            return 1;
+        }
+    }
+    printf("%-32s %12.0f\n", "defer_tmpdir (4 files per dir)", (double)(iterations / 4 * 4) / (now_sec() - start));
+    return 0;
+}
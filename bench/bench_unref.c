@@ -0,0 +1,117 @@
+/**
+ * @file bench_unref.c
+ * @brief Scope-exit reference release: shared atomic count versus defer_unref
+ *
+ * Every thread repeatedly opens a scope that releases one reference to a
+ * shared object on exit. References are taken up front by the owning
+ * thread, so the timed loop is pure release traffic. The baseline does an
+ * atomic decrement per scope on one shared cache line; defer_unref buffers
+ * releases per thread and merges them in batches.
+ *
+ * Usage: bench_unref [iterations_per_thread]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#define DEFER_IMPLEMENTATION
+#include "../defer.h"
+
+#define MAX_THREADS 64
+
+typedef struct {
+    long count;
+    defer_ref_t ref;
+    int destroyed;
+} object_t;
+
+typedef struct {
+    object_t* object;
+    long iterations;
+    int use_defer;
+    volatile int* go;
+} worker_t;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void release_atomic(void* arg) {
+    object_t* object = (object_t*)arg;
+    if (__atomic_sub_fetch(&object->count, 1, __ATOMIC_ACQ_REL) == 0) {
+        object->destroyed = 1;
+    }
+}
+
+static void destroy_object(void* arg) {
+    ((object_t*)arg)->destroyed = 1;
+}
+
+static void* worker_main(void* arg) {
+    worker_t* worker = (worker_t*)arg;
+    while (!*worker->go) {
+    }
+    if (worker->use_defer) {
+        for (long i = 0; i < worker->iterations; i++) {
+            defer_unref(&worker->object->ref);
+        }
+    } else {
+        for (long i = 0; i < worker->iterations; i++) {
+            defer(release_atomic, worker->object);
+        }
+    }
+    return NULL;
+}
+
+static double run(int threads, long iterations, int use_defer) {
+    object_t object = { 1, {0}, 0 };
+    defer_ref_init(&object.ref, destroy_object, &object);
+    for (long i = 0; i < threads * iterations; i++) {
+        if (use_defer) {
+            defer_ref_acquire(&object.ref);  // Owner side: plain increment
+        } else {
+            object.count++;
+        }
+    }
+
+    worker_t workers[MAX_THREADS];
+    pthread_t tids[MAX_THREADS];
+    volatile int go = 0;
+    for (int i = 0; i < threads; i++) {
+        workers[i] = (worker_t){ &object, iterations, use_defer, &go };
+        pthread_create(&tids[i], NULL, worker_main, &workers[i]);
+    }
+    double start = now_sec();
+    go = 1;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);  // Thread exit flushes buffered releases
+    }
+    double elapsed = now_sec() - start;
+
+    // Drop the owner's own reference
+    if (use_defer) {
+        defer_ref_release(&object.ref);
+    } else {
+        release_atomic(&object);
+    }
+    if (!object.destroyed) {
+        printf("object was not destroyed\n");
+        exit(1);
+    }
+    return (double)(threads * iterations) / elapsed / 1e6;
+}
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 2000000;
+    printf("%8s %16s %20s\n", "threads", "atomic Mrel/s", "defer_unref Mrel/s");
+    for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+        double atomic = run(threads, iterations / threads > 0 ? iterations / threads : 1, 0);
+        double biased = run(threads, iterations / threads > 0 ? iterations / threads : 1, 1);
+        printf("%8d %16.1f %20.1f\n", threads, atomic, biased);
+    }
+    return 0;
+}
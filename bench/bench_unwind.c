@@ -0,0 +1,107 @@
+/**
+ * @file bench_unwind.c
+ * @brief Error-code propagation versus defer_throw unwinding
+ *
+ * A chain of DEPTH calls holds one resource per frame. The innermost call
+ * fails with the given probability. The error-code version checks and
+ * returns a status at every level; the unwinding version registers a
+ * dynamic defer per frame and throws from the leaf to a defer_try at the
+ * top. Reports calls per second at several failure rates.
+ *
+ * Usage: bench_unwind [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#define DEFER_IMPLEMENTATION
+#include "../defer.h"
+
+#define DEPTH 12
+
+static long live_resources = 0;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void release(void* arg) {
+    (void)arg;
+    live_resources--;
+}
+
+static int leaf_fails(uint64_t* rng, uint64_t threshold) {
+    *rng ^= *rng << 13;
+    *rng ^= *rng >> 7;
+    *rng ^= *rng << 17;
+    return *rng < threshold;
+}
+
+__attribute__((noinline)) static int chain_codes(int depth, uint64_t* rng, uint64_t threshold) {
+    live_resources++;
+    defer(release, rng);
+    if (depth == 0) {
+        return leaf_fails(rng, threshold) ? -1 : 0;
+    }
+    int rc = chain_codes(depth - 1, rng, threshold);
+    if (rc != 0) {
+        return rc;
+    }
+    return 0;
+}
+
+__attribute__((noinline)) static void chain_unwind(int depth, uint64_t* rng, uint64_t threshold) {
+    live_resources++;
+    defer_dynamic(release, rng);
+    if (depth == 0) {
+        if (leaf_fails(rng, threshold)) {
+            defer_throw(-1);
+        }
+        return;
+    }
+    chain_unwind(depth - 1, rng, threshold);
+}
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 2000000;
+    const double rates[] = { 0.0, 0.001, 0.01, 0.1, 0.5 };
+
+    printf("depth %d, %ld calls per run\n", DEPTH, iterations);
+    printf("%10s %18s %18s\n", "fail rate", "error codes Mops/s", "defer_throw Mops/s");
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        uint64_t threshold = (uint64_t)(rates[r] * 18446744073709551615.0);
+
+        uint64_t rng = 88172645463325252ULL;
+        long failures = 0;
+        double start = now_sec();
+        for (long i = 0; i < iterations; i++) {
+            failures += chain_codes(DEPTH, &rng, threshold) != 0;
+        }
+        double codes = (double)iterations / (now_sec() - start) / 1e6;
+
+        rng = 88172645463325252ULL;
+        volatile long thrown = 0;
+        start = now_sec();
+        // volatile: the counter lives across the setjmp in defer_try
+        for (volatile long i = 0; i < iterations; i++) {
+            defer_try {
+                chain_unwind(DEPTH, &rng, threshold);
+            } defer_catch(err) {
+                (void)err;
+                thrown++;
+            }
+        }
+        double unwind = (double)iterations / (now_sec() - start) / 1e6;
+
+        if (failures != thrown || live_resources != 0) {
+            printf("mismatch: %ld failures, %ld throws, %ld live\n", failures, (long)thrown, live_resources);
+            return 1;
+        }
+        printf("%9.1f%% %18.1f %18.1f\n", rates[r] * 100.0, codes, unwind);
+    }
+    return 0;
+}
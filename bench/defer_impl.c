@@ -0,0 +1,10 @@
+/**
+ * @file defer_impl.c
+ * @brief defer.h implementation as its own translation unit
+ *
+ * Benchmarks link this file the way an application builds the implementation
+ * in one source file, so cleanup_free() and friends stay external calls.
+ */
+
+#define DEFER_IMPLEMENTATION
+#include "../defer.h"
@@ -0,0 +1,257 @@
+/**
+ * @file soak.c
+ * @brief Multi-core scaling and long-duration soak of defer-heavy scopes
+ *
+ * Every scope allocates a buffer (defer_free), rewrites a per-thread file on
+ * tmpfs (defer_fclose) and bounces a byte over a socketpair (defer_close on
+ * both ends). The scaling sweep runs 1 to N threads for a fixed time each and
+ * reports throughput per thread, scaling efficiency against one thread and
+ * p99 scope latency. The soak phase then runs N threads for the full duration
+ * and samples RSS and the descriptor count from /proc/self every second; any
+ * descriptor drift fails the run.
+ *
+ * Usage: soak [soak_seconds] [max_threads] [step_seconds] [dir]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/socket.h>
+
+// Tracing every free would measure stdout instead of the defers
+#define DEFER_TRACE_FREE 0
+#define DEFER_IMPLEMENTATION
+#include "../defer.h"
+
+#define MAX_THREADS 256
+#define SCOPE_BYTES 4096
+#define LATENCY_BUCKETS 10000  // 1 us each; the last also counts anything slower
+
+typedef struct {
+    char path[512];
+    volatile int* stop;
+    unsigned long scopes;
+    int failed;
+    // A fixed histogram, so latency tracking adds nothing to the RSS drift
+    uint32_t latency[LATENCY_BUCKETS];
+} worker_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static long rss_kb(void) {
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm) {
+        return -1;
+    }
+    defer_fclose(statm);
+    long size, resident;
+    if (fscanf(statm, "%ld %ld", &size, &resident) != 2) {
+        return -1;
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static int open_fds(void) {
+    DIR* dir = opendir("/proc/self/fd");
+    if (!dir) {
+        return -1;
+    }
+    int count = 0;
+    while (readdir(dir)) {
+        count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+static int one_scope(worker_t* worker, unsigned long i) {
+    char* buffer = malloc(SCOPE_BYTES);
+    if (!buffer) {
+        return -1;
+    }
+    defer_free(buffer);
+    memset(buffer, (int)(i & 0xff), SCOPE_BYTES);
+
+    FILE* file = fopen(worker->path, "w");
+    if (!file) {
+        return -1;
+    }
+    defer_fclose(file);
+    if (fwrite(buffer, 1, SCOPE_BYTES, file) != SCOPE_BYTES) {
+        return -1;
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        return -1;
+    }
+    defer_close(&fds[0]);
+    defer_close(&fds[1]);
+    if (write(fds[0], buffer, 1) != 1 || read(fds[1], buffer, 1) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+static void* worker_main(void* arg) {
+    worker_t* worker = (worker_t*)arg;
+    for (unsigned long i = 0; !*worker->stop; i++) {
+        uint64_t start = now_ns();
+        if (one_scope(worker, i) != 0) {
+            worker->failed = 1;
+            return NULL;
+        }
+        uint64_t us = (now_ns() - start) / 1000;
+        worker->latency[us < LATENCY_BUCKETS ? us : LATENCY_BUCKETS - 1]++;
+        __atomic_store_n(&worker->scopes, worker->scopes + 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+typedef struct {
+    double scopes_per_sec;
+    double p99_us;
+    int failed;
+} run_result_t;
+
+// Runs threads workers for seconds; report, when set, is called once a
+// second with the elapsed time and the scopes completed so far
+static run_result_t run(int threads, double seconds, const char* dir,
+                        void (*report)(double elapsed, unsigned long scopes)) {
+    run_result_t result = { 0.0, 0.0, 1 };
+    worker_t* workers = calloc((size_t)threads, sizeof(worker_t));
+    if (!workers) {
+        return result;
+    }
+    defer_free(workers);
+    pthread_t tids[MAX_THREADS];
+    volatile int stop = 0;
+    int started = 0;
+    for (int i = 0; i < threads; i++) {
+        snprintf(workers[i].path, sizeof(workers[i].path), "%s/soak_%d.tmp", dir, i);
+        workers[i].stop = &stop;
+        if (pthread_create(&tids[i], NULL, worker_main, &workers[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    uint64_t start = now_ns();
+    for (int tick = 1; started == threads && tick <= (int)seconds; tick++) {
+        struct timespec ts = { 1, 0 };
+        nanosleep(&ts, NULL);
+        if (report) {
+            unsigned long scopes = 0;
+            for (int i = 0; i < threads; i++) {
+                scopes += __atomic_load_n(&workers[i].scopes, __ATOMIC_RELAXED);
+            }
+            report((double)(now_ns() - start) / 1e9, scopes);
+        }
+    }
+    double rest = seconds - (double)(now_ns() - start) / 1e9;
+    if (rest > 0 && started == threads) {
+        struct timespec ts = { (time_t)rest, (long)((rest - (double)(time_t)rest) * 1e9) };
+        nanosleep(&ts, NULL);
+    }
+    stop = 1;
+
+    unsigned long scopes = 0;
+    int failed = started < threads;
+    for (int i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+        scopes += workers[i].scopes;
+        failed |= workers[i].failed;
+        remove(workers[i].path);
+    }
+    double elapsed = (double)(now_ns() - start) / 1e9;
+
+    // p99 is the upper edge of the bucket holding the 99th percentile scope
+    unsigned long seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS && scopes > 0; bucket++) {
+        for (int i = 0; i < started; i++) {
+            seen += workers[i].latency[bucket];
+        }
+        if (seen * 100 >= scopes * 99) {
+            result.p99_us = bucket + 1;
+            break;
+        }
+    }
+    result.scopes_per_sec = (double)scopes / elapsed;
+    result.failed = failed || scopes == 0;
+    return result;
+}
+
+static long soak_rss_start = -1, soak_rss_last;
+static int soak_fds_start = -1;
+static unsigned long soak_last_scopes;
+static double soak_last_elapsed;
+
+static void soak_report(double elapsed, unsigned long scopes) {
+    long rss = rss_kb();
+    int fds = open_fds();
+    if (soak_rss_start < 0) {
+        soak_rss_start = rss;
+        soak_fds_start = fds;
+    }
+    soak_rss_last = rss;
+    printf("%8.0f %14.0f %10ld %+10ld %6d %+6d\n", elapsed,
+           (double)(scopes - soak_last_scopes) / (elapsed - soak_last_elapsed),
+           rss, rss - soak_rss_start, fds, fds - soak_fds_start);
+    fflush(stdout);
+    soak_last_scopes = scopes;
+    soak_last_elapsed = elapsed;
+}
+
+int main(int argc, char** argv) {
+    double soak_seconds = argc > 1 ? atof(argv[1]) : 30.0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = argc > 2 && atoi(argv[2]) > 0 ? atoi(argv[2]) : (int)(cpus > 0 ? cpus : 1);
+    double step_seconds = argc > 3 ? atof(argv[3]) : 2.0;
+    const char* dir = argc > 4 ? argv[4] : (access("/dev/shm", W_OK) == 0 ? "/dev/shm" : "build");
+    if (max_threads > MAX_THREADS) {
+        max_threads = MAX_THREADS;
+    }
+
+    printf("Scaling: %.0fs per step, scope = defer_free + defer_fclose (%s) + 2x defer_close\n",
+           step_seconds, dir);
+    printf("%8s %14s %14s %11s %10s\n", "threads", "scopes/s", "per thread", "efficiency", "p99 us");
+    double single = 0.0;
+    for (int threads = 1;; threads = threads * 2 > max_threads && threads < max_threads ? max_threads : threads * 2) {
+        run_result_t result = run(threads, step_seconds, dir, NULL);
+        if (result.failed) {
+            printf("Scope failed at %d threads\n", threads);
+            return 1;
+        }
+        if (threads == 1) {
+            single = result.scopes_per_sec;
+        }
+        printf("%8d %14.0f %14.0f %10.1f%% %10.0f\n", threads, result.scopes_per_sec,
+               result.scopes_per_sec / threads, 100.0 * result.scopes_per_sec / (single * threads),
+               result.p99_us);
+        if (threads >= max_threads) {
+            break;
+        }
+    }
+
+    printf("\nSoak: %d threads for %.0fs, drift is against the first sample\n", max_threads, soak_seconds);
+    printf("%8s %14s %10s %10s %6s %6s\n", "seconds", "scopes/s", "RSS KB", "drift", "fds", "drift");
+    int fds_before = open_fds();
+    run_result_t result = run(max_threads, soak_seconds, dir, soak_report);
+    if (result.failed) {
+        printf("Scope failed during the soak\n");
+        return 1;
+    }
+    // Workers hold descriptors while sampled, so leaks are judged once joined
+    int fd_drift = open_fds() - fds_before;
+    printf("p99 %.0f us, RSS drift %+ld KB, fds after join %+d\n", result.p99_us,
+           soak_rss_start < 0 ? 0 : soak_rss_last - soak_rss_start, fd_drift);
+    return fd_drift != 0 ? 1 : 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file stack_usage.c
+ * @brief Per-frame stack cost of regular versus compact defers
+ *
+ * A recursive-descent style function holds three buffer defers and one
+ * token defer per frame. `make stack-usage` builds it normally and with
+ * DEFER_COMPACT, at -O0, -Og and -O2, prints the compiler's -fstack-usage figure
+ * for each build and runs it to measure the bytes each recursion level
+ * consumes. The implementation is linked from defer_impl.c, as in an
+ * application.
+ *
+ * Usage: stack_usage [depth]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+// Implementation comes from defer_impl.c, as in a multi-file application
+#include "../defer.h"
+
+typedef struct {
+    int depth;
+    uintptr_t deepest;  // Lowest stack address seen
+} parse_state_t;
+
+static void release_token(void* arg) {
+    ((parse_state_t*)arg)->depth--;
+}
+
+// Same shapes as defer_free, minus cleanup_free's logging
+#ifdef DEFER_COMPACT
+DEFER_COMPACT_THUNK(free_thunk, free)
+DEFER_COMPACT_THUNK(release_token_thunk, release_token)
+#define defer_buffer(ptr) defer_compact(free_thunk, ptr)
+#define defer_release_token(state) defer_compact(release_token_thunk, state)
+#else
+#define defer_buffer(ptr) defer(free, ptr)
+#define defer_release_token(state) defer(release_token, state)
+#endif
+
+__attribute__((noinline)) static size_t parse_node(parse_state_t* state, int remaining) {
+    char* name = malloc(16);
+    defer_buffer(name);
+    char* attrs = malloc(32);
+    defer_buffer(attrs);
+    char* text = malloc(64);
+    defer_buffer(text);
+    state->depth++;
+    defer_release_token(state);
+
+    uintptr_t here = (uintptr_t)__builtin_frame_address(0);
+    if (here < state->deepest) {
+        state->deepest = here;
+    }
+    if (!name || !attrs || !text || remaining == 0) {
+        return 1;
+    }
+    return 1 + parse_node(state, remaining - 1);
+}
+
+int main(int argc, char** argv) {
+    int depth = argc > 1 ? atoi(argv[1]) : 1000;
+    parse_state_t state = { 0, UINTPTR_MAX };
+    uintptr_t top = (uintptr_t)__builtin_frame_address(0);
+    size_t nodes = parse_node(&state, depth);
+    if (state.depth != 0) {
+        printf("cleanup mismatch\n");
+        return 1;
+    }
+#ifdef DEFER_COMPACT
+    const char* mode = "compact";
+#else
+    const char* mode = "regular";
+#endif
+    printf("%-8s %zu frames, %.1f bytes/frame\n", mode, nodes, (double)(top - state.deepest) / (double)nodes);
+    return 0;
+}
@@ -0,0 +1,770 @@
+	.file	"snippets_defer.c"
+	.text
+	.section	.text.unlikely,"ax",@progbits
+.LCOLDB0:
+	.text
+.LHOTB0:
+	.p2align 4
+	.globl	one_free
+	.type	one_free, @function
+one_free:
+.LFB37:
+	.cfi_startproc
+	.cfi_personality 0x9b,DW.ref.__gcc_personality_v0
+	.cfi_lsda 0x1b,.LLSDA37
+	pushq	%rbp
+	.cfi_def_cfa_offset 16
+	.cfi_offset 6, -16
+	pushq	%rbx
+	.cfi_def_cfa_offset 24
+	.cfi_offset 3, -24
+	subq	$8, %rsp
+	.cfi_def_cfa_offset 32
+	call	malloc@PLT
+	testq	%rax, %rax
+	je	.L4
+	movq	%rax, %rdi
+	movq	%rax, %rbx
+.LEHB0:
+	call	consume@PLT
+.LEHE0:
+	movq	%rbx, %rdi
+.LEHB1:
+	call	cleanup_free@PLT
+.LEHE1:
+	xorl	%eax, %eax
+.L1:
+	addq	$8, %rsp
+	.cfi_remember_state
+	.cfi_def_cfa_offset 24
+	popq	%rbx
+	.cfi_def_cfa_offset 16
+	popq	%rbp
+	.cfi_def_cfa_offset 8
+	ret
+.L4:
+	.cfi_restore_state
+	orl	$-1, %eax
+	jmp	.L1
+.L5:
+	movq	%rax, %rbp
+	jmp	.L3
+	.globl	__gcc_personality_v0
+	.section	.gcc_except_table,"a",@progbits
+.LLSDA37:
+	.byte	0xff
+	.byte	0xff
+	.byte	0x1
+	.uleb128 .LLSDACSE37-.LLSDACSB37
+.LLSDACSB37:
+	.uleb128 .LEHB0-.LFB37
+	.uleb128 .LEHE0-.LEHB0
+	.uleb128 .L5-.LFB37
+	.uleb128 0
+	.uleb128 .LEHB1-.LFB37
+	.uleb128 .LEHE1-.LEHB1
+	.uleb128 0
+	.uleb128 0
+.LLSDACSE37:
+	.text
+	.cfi_endproc
+	.section	.text.unlikely
+	.cfi_startproc
+	.cfi_personality 0x9b,DW.ref.__gcc_personality_v0
+	.cfi_lsda 0x1b,.LLSDAC37
+	.type	one_free.cold, @function
+one_free.cold:
+.LFSB37:
+.L3:
+	.cfi_def_cfa_offset 32
+	.cfi_offset 3, -24
+	.cfi_offset 6, -16
+	movq	%rbx, %rdi
+.LEHB2:
+	call	cleanup_free@PLT
+	movq	%rbp, %rdi
+	call	_Unwind_Resume@PLT
+.LEHE2:
+	.cfi_endproc
+.LFE37:
+	.section	.gcc_except_table
+.LLSDAC37:
+	.byte	0xff
+	.byte	0xff
+	.byte	0x1
+	.uleb128 .LLSDACSEC37-.LLSDACSBC37
+.LLSDACSBC37:
+	.uleb128 .LEHB2-.LCOLDB0
+	.uleb128 .LEHE2-.LEHB2
+	.uleb128 0
+	.uleb128 0
+.LLSDACSEC37:
+	.section	.text.unlikely
+	.text
+	.size	one_free, .-one_free
+	.section	.text.unlikely
+	.size	one_free.cold, .-one_free.cold
+.LCOLDE0:
+	.text
+.LHOTE0:
+	.section	.rodata.str1.1,"aMS",@progbits,1
+.LC1:
+	.string	"r"
+	.section	.text.unlikely
+.LCOLDB2:
+	.text
+.LHOTB2:
+	.p2align 4
+	.globl	one_fclose
+	.type	one_fclose, @function
+one_fclose:
+.LFB38:
+	.cfi_startproc
+	.cfi_personality 0x9b,DW.ref.__gcc_personality_v0
+	.cfi_lsda 0x1b,.LLSDA38
+	pushq	%rbp
+	.cfi_def_cfa_offset 16
+	.cfi_offset 6, -16
+	leaq	.LC1(%rip), %rsi
+	pushq	%rbx
+	.cfi_def_cfa_offset 24
+	.cfi_offset 3, -24
+	subq	$8, %rsp
+	.cfi_def_cfa_offset 32
+.LEHB3:
+	call	fopen@PLT
+.LEHE3:
+	testq	%rax, %rax
+	je	.L11
+	movq	%rax, %rdi
+	movq	%rax, %rbx
+.LEHB4:
+	call	fgetc@PLT
+.LEHE4:
+	movq	%rbx, %rdi
+	movl	%eax, %ebp
+.LEHB5:
+	call	cleanup_fclose@PLT
+.LEHE5:
+.L8:
+	addq	$8, %rsp
+	.cfi_remember_state
+	.cfi_def_cfa_offset 24
+	movl	%ebp, %eax
+	popq	%rbx
+	.cfi_def_cfa_offset 16
+	popq	%rbp
+	.cfi_def_cfa_offset 8
+	ret
+.L11:
+	.cfi_restore_state
+	orl	$-1, %ebp
+	jmp	.L8
+.L12:
+	movq	%rax, %rbp
+	jmp	.L10
+	.section	.gcc_except_table
+.LLSDA38:
+	.byte	0xff
+	.byte	0xff
+	.byte	0x1
+	.uleb128 .LLSDACSE38-.LLSDACSB38
+.LLSDACSB38:
+	.uleb128 .LEHB3-.LFB38
+	.uleb128 .LEHE3-.LEHB3
+	.uleb128 0
+	.uleb128 0
+	.uleb128 .LEHB4-.LFB38
+	.uleb128 .LEHE4-.LEHB4
+	.uleb128 .L12-.LFB38
+	.uleb128 0
+	.uleb128 .LEHB5-.LFB38
+	.uleb128 .LEHE5-.LEHB5
+	.uleb128 0
+	.uleb128 0
+.LLSDACSE38:
+	.text
+	.cfi_endproc
+	.section	.text.unlikely
+	.cfi_startproc
+	.cfi_personality 0x9b,DW.ref.__gcc_personality_v0
+	.cfi_lsda 0x1b,.LLSDAC38
+	.type	one_fclose.cold, @function
+one_fclose.cold:
+.LFSB38:
+.L10:
+	.cfi_def_cfa_offset 32
+	.cfi_offset 3, -24
+	.cfi_offset 6, -16
+	movq	%rbx, %rdi
+.LEHB6:
+	call	cleanup_fclose@PLT
+	movq	%rbp, %rdi
+	call	_Unwind_Resume@PLT
+.LEHE6:
+	.cfi_endproc
+.LFE38:
+	.section	.gcc_except_table
+.LLSDAC38:
+	.byte	0xff
+	.byte	0xff
+	.byte	0x1
+	.uleb128 .LLSDACSEC38-.LLSDACSBC38
+.LLSDACSBC38:
+	.uleb128 .LEHB6-.LCOLDB2
+	.uleb128 .LEHE6-.LEHB6
+	.uleb128 0
+	.uleb128 0
+.LLSDACSEC38:
+	.section	.text.unlikely
+	.text
+	.size	one_fclose, .-one_fclose
+	.section	.text.unlikely
+	.size	one_fclose.cold, .-one_fclose.cold
+.LCOLDE2:
+	.text
+.LHOTE2:
+	.section	.text.unlikely
+.LCOLDB3:
+	.text
+.LHOTB3:
+	.p2align 4
+	.globl	multiple
+	.type	multiple, @function
+multiple:
+.LFB39:
+	.cfi_startproc
+	.cfi_personality 0x9b,DW.ref.__gcc_personality_v0
+	.cfi_lsda 0x1b,.LLSDA39
+	pushq	%r13
+	.cfi_def_cfa_offset 16
+	.cfi_offset 13, -16
+	pushq	%r12
+	.cfi_def_cfa_offset 24
+	.cfi_offset 12, -24
+	pushq	%rbp
+	.cfi_def_cfa_offset 32
+	.cfi_offset 6, -32
+	movq	%rdi, %rbp
+	pushq	%rbx
+	.cfi_def_cfa_offset 40
+	.cfi_offset 3, -40
+	subq	$8, %rsp
+	.cfi_def_cfa_offset 48
+	call	malloc@PLT
+	testq	%rax, %rax
+	je	.L21
+	movq	%rbp, %rdi
+	movq	%rax, %rbx
+	call	malloc@PLT
+	movq	%rax, %r12
+	testq	%rax, %rax
+	je	.L22
+	movq	%rbp, %rdi
+	call	malloc@PLT
+	movq	%rax, %rbp
+	testq	%rax, %rax
+	je	.L23
+	movq	%rbx, %rdi
+.LEHB7:
+	call	consume@PLT
+	movq	%r12, %rdi
+	call	consume@PLT
+	movq	%rbp, %rdi
+	call	consume@PLT
+.LEHE7:
+	movq	%rbp, %rdi
+.LEHB8:
+	call	cleanup_free@PLT
+.LEHE8:
+	xorl	%ebp, %ebp
+.L17:
+	movq	%r12, %rdi
+.LEHB9:
+	call	cleanup_free@PLT
+.LEHE9:
+.L16:
+	movq	%rbx, %rdi
+.LEHB10:
+	call	cleanup_free@PLT
+.LEHE10:
+.L14:
+	addq	$8, %rsp
+	.cfi_remember_state
+	.cfi_def_cfa_offset 40
+	movl	%ebp, %eax
+	popq	%rbx
+	.cfi_def_cfa_offset 32
+	popq	%rbp
+	.cfi_def_cfa_offset 24
+	popq	%r12
+	.cfi_def_cfa_offset 16
+	popq	%r13
+	.cfi_def_cfa_offset 8
+	ret
+.L21:
+	.cfi_restore_state
+	orl	$-1, %ebp
+	jmp	.L14
+.L23:
+	orl	$-1, %ebp
+	jmp	.L17
+.L22:
+	orl	$-1, %ebp
+	jmp	.L16
+.L29:
+	jmp	.L30
+.L27:
+	jmp	.L28
+.L24:
+	movq	%rax, %r13
+	jmp	.L18
+	.section	.gcc_except_table
+.LLSDA39:
+	.byte	0xff
+	.byte	0xff
+	.byte	0x1
+	.uleb128 .LLSDACSE39-.LLSDACSB39
+.LLSDACSB39:
+	.uleb128 .LEHB7-.LFB39
+	.uleb128 .LEHE7-.LEHB7
+	.uleb128 .L24-.LFB39
+	.uleb128 0
+	.uleb128 .LEHB8-.LFB39
+	.uleb128 .LEHE8-.LEHB8
+	.uleb128 .L27-.LFB39
+	.uleb128 0
+	.uleb128 .LEHB9-.LFB39
+	.uleb128 .LEHE9-.LEHB9
+	.uleb128 .L29-.LFB39
+	.uleb128 0
+	.uleb128 .LEHB10-.LFB39
+	.uleb128 .LEHE10-.LEHB10
+	.uleb128 0
+	.uleb128 0
+.LLSDACSE39:
+	.text
+	.cfi_endproc
+	.section	.text.unlikely
+	.cfi_startproc
+	.cfi_personality 0x9b,DW.ref.__gcc_personality_v0
+	.cfi_lsda 0x1b,.LLSDAC39
+	.type	multiple.cold, @function
+multiple.cold:
+.LFSB39:
+	nop
+.L26:
+	.cfi_def_cfa_offset 48
+	.cfi_offset 3, -40
+	.cfi_offset 6, -32
+	.cfi_offset 12, -24
+	.cfi_offset 13, -16
+.L30:
+	movq	%rax, %rbp
+.L20:
+	movq	%rbx, %rdi
+.LEHB11:
+	call	cleanup_free@PLT
+	movq	%rbp, %rdi
+	call	_Unwind_Resume@PLT
+.LEHE11:
+.L25:
+.L28:
+	movq	%rax, %rbp
+.L19:
+	movq	%r12, %rdi
+.LEHB12:
+	call	cleanup_free@PLT
+.LEHE12:
+	jmp	.L20
+.L18:
+	movq	%rbp, %rdi
+.LEHB13:
+	call	cleanup_free@PLT
+.LEHE13:
+	movq	%r13, %rbp
+	jmp	.L19
+	.cfi_endproc
+.LFE39:
+	.section	.gcc_except_table
+.LLSDAC39:
+	.byte	0xff
+	.byte	0xff
+	.byte	0x1
+	.uleb128 .LLSDACSEC39-.LLSDACSBC39
+.LLSDACSBC39:
+	.uleb128 .LEHB11-.LCOLDB3
+	.uleb128 .LEHE11-.LEHB11
+	.uleb128 0
+	.uleb128 0
+	.uleb128 .LEHB12-.LCOLDB3
+	.uleb128 .LEHE12-.LEHB12
+	.uleb128 .L26-.LCOLDB3
+	.uleb128 0
+	.uleb128 .LEHB13-.LCOLDB3
+	.uleb128 .LEHE13-.LEHB13
+	.uleb128 .L25-.LCOLDB3
+	.uleb128 0
+.LLSDACSEC39:
+	.section	.text.unlikely
+	.text
+	.size	multiple, .-multiple
+	.section	.text.unlikely
+	.size	multiple.cold, .-multiple.cold
+.LCOLDE3:
+	.text
+.LHOTE3:
+	.section	.text.unlikely
+.LCOLDB4:
+	.text
+.LHOTB4:
+	.p2align 4
+	.globl	nested
+	.type	nested, @function
+nested:
+.LFB40:
+	.cfi_startproc
+	.cfi_personality 0x9b,DW.ref.__gcc_personality_v0
+	.cfi_lsda 0x1b,.LLSDA40
+	pushq	%r14
+	.cfi_def_cfa_offset 16
+	.cfi_offset 14, -16
+	pushq	%r13
+	.cfi_def_cfa_offset 24
+	.cfi_offset 13, -24
+	movl	%esi, %r13d
+	pushq	%r12
+	.cfi_def_cfa_offset 32
+	.cfi_offset 12, -32
+	movq	%rdi, %r12
+	pushq	%rbp
+	.cfi_def_cfa_offset 40
+	.cfi_offset 6, -40
+	pushq	%rbx
+	.cfi_def_cfa_offset 48
+	.cfi_offset 3, -48
+	call	malloc@PLT
+	testq	%rax, %rax
+	je	.L42
+	movq	%rax, %r14
+	testl	%r13d, %r13d
+	jle	.L34
+	xorl	%ebp, %ebp
+	.p2align 4,,10
+	.p2align 3
+.L36:
+	movq	%r12, %rdi
+	call	malloc@PLT
+	movq	%rax, %rdi
+	movq	%rax, %rbx
+.LEHB14:
+	call	consume@PLT
+.LEHE14:
+	testq	%rbx, %rbx
+	je	.L37
+	movq	%rbx, %rdi
+.LEHB15:
+	call	cleanup_free@PLT
+.L37:
+	addl	$1, %ebp
+	cmpl	%ebp, %r13d
+	jne	.L36
+.L34:
+	movq	%r14, %rdi
+	call	consume@PLT
+.LEHE15:
+	movq	%r14, %rdi
+.LEHB16:
+	call	cleanup_free@PLT
+.LEHE16:
+	xorl	%eax, %eax
+.L32:
+	popq	%rbx
+	.cfi_remember_state
+	.cfi_def_cfa_offset 40
+	popq	%rbp
+	.cfi_def_cfa_offset 32
+	popq	%r12
+	.cfi_def_cfa_offset 24
+	popq	%r13
+	.cfi_def_cfa_offset 16
+	popq	%r14
+	.cfi_def_cfa_offset 8
+	ret
+.L42:
+	.cfi_restore_state
+	orl	$-1, %eax
+	jmp	.L32
+.L46:
+	jmp	.L47
+.L43:
+	movq	%rax, %rbp
+	jmp	.L38
+	.section	.gcc_except_table
+.LLSDA40:
+	.byte	0xff
+	.byte	0xff
+	.byte	0x1
+	.uleb128 .LLSDACSE40-.LLSDACSB40
+.LLSDACSB40:
+	.uleb128 .LEHB14-.LFB40
+	.uleb128 .LEHE14-.LEHB14
+	.uleb128 .L43-.LFB40
+	.uleb128 0
+	.uleb128 .LEHB15-.LFB40
+	.uleb128 .LEHE15-.LEHB15
+	.uleb128 .L46-.LFB40
+	.uleb128 0
+	.uleb128 .LEHB16-.LFB40
+	.uleb128 .LEHE16-.LEHB16
+	.uleb128 0
+	.uleb128 0
+.LLSDACSE40:
+	.text
+	.cfi_endproc
+	.section	.text.unlikely
+	.cfi_startproc
+	.cfi_personality 0x9b,DW.ref.__gcc_personality_v0
+	.cfi_lsda 0x1b,.LLSDAC40
+	.type	nested.cold, @function
+nested.cold:
+.LFSB40:
+	nop
+.L44:
+	.cfi_def_cfa_offset 48
+	.cfi_offset 3, -48
+	.cfi_offset 6, -40
+	.cfi_offset 12, -32
+	.cfi_offset 13, -24
+	.cfi_offset 14, -16
+.L47:
+	movq	%rax, %rbp
+.L40:
+	movq	%r14, %rdi
+.LEHB17:
+	call	cleanup_free@PLT
+	movq	%rbp, %rdi
+	call	_Unwind_Resume@PLT
+.LEHE17:
+.L38:
+	testq	%rbx, %rbx
+	je	.L40
+	movq	%rbx, %rdi
+.LEHB18:
+	call	cleanup_free@PLT
+.LEHE18:
+	jmp	.L40
+	.cfi_endproc
+.LFE40:
+	.section	.gcc_except_table
+.LLSDAC40:
+	.byte	0xff
+	.byte	0xff
+	.byte	0x1
+	.uleb128 .LLSDACSEC40-.LLSDACSBC40
+.LLSDACSBC40:
+	.uleb128 .LEHB17-.LCOLDB4
+	.uleb128 .LEHE17-.LEHB17
+	.uleb128 0
+	.uleb128 0
+	.uleb128 .LEHB18-.LCOLDB4
+	.uleb128 .LEHE18-.LEHB18
+	.uleb128 .L44-.LCOLDB4
+	.uleb128 0
+.LLSDACSEC40:
+	.section	.text.unlikely
+	.text
+	.size	nested, .-nested
+	.section	.text.unlikely
+	.size	nested.cold, .-nested.cold
+.LCOLDE4:
+	.text
+.LHOTE4:
+	.section	.text.unlikely
+.LCOLDB5:
+	.text
+.LHOTB5:
+	.p2align 4
+	.globl	early_return
+	.type	early_return, @function
+early_return:
+.LFB41:
+	.cfi_startproc
+	.cfi_personality 0x9b,DW.ref.__gcc_personality_v0
+	.cfi_lsda 0x1b,.LLSDA41
+	pushq	%r13
+	.cfi_def_cfa_offset 16
+	.cfi_offset 13, -16
+	pushq	%r12
+	.cfi_def_cfa_offset 24
+	.cfi_offset 12, -24
+	movq	%rsi, %r12
+	leaq	.LC1(%rip), %rsi
+	pushq	%rbp
+	.cfi_def_cfa_offset 32
+	.cfi_offset 6, -32
+	pushq	%rbx
+	.cfi_def_cfa_offset 40
+	.cfi_offset 3, -40
+	subq	$8, %rsp
+	.cfi_def_cfa_offset 48
+.LEHB19:
+	call	fopen@PLT
+.LEHE19:
+	testq	%rax, %rax
+	je	.L55
+	movq	%r12, %rdi
+	movq	%rax, %r13
+	call	malloc@PLT
+	movq	%rax, %rbx
+	testq	%rax, %rax
+	je	.L56
+	movq	%r13, %rcx
+	movq	%r12, %rdx
+	movl	$1, %esi
+	movq	%rax, %rdi
+.LEHB20:
+	call	fread@PLT
+.LEHE20:
+	movl	$-3, %ebp
+	cmpq	%rax, %r12
+	je	.L63
+.L52:
+	movq	%rbx, %rdi
+.LEHB21:
+	call	cleanup_free@PLT
+.LEHE21:
+.L51:
+	movq	%r13, %rdi
+.LEHB22:
+	call	cleanup_fclose@PLT
+.LEHE22:
+.L49:
+	addq	$8, %rsp
+	.cfi_remember_state
+	.cfi_def_cfa_offset 40
+	movl	%ebp, %eax
+	popq	%rbx
+	.cfi_def_cfa_offset 32
+	popq	%rbp
+	.cfi_def_cfa_offset 24
+	popq	%r12
+	.cfi_def_cfa_offset 16
+	popq	%r13
+	.cfi_def_cfa_offset 8
+	ret
+	.p2align 4,,10
+	.p2align 3
+.L63:
+	.cfi_restore_state
+	movq	%rbx, %rdi
+.LEHB23:
+	call	consume@PLT
+.LEHE23:
+	xorl	%ebp, %ebp
+	jmp	.L52
+.L56:
+	movl	$-2, %ebp
+	jmp	.L51
+.L55:
+	orl	$-1, %ebp
+	jmp	.L49
+.L58:
+	movq	%rax, %rbp
+	jmp	.L53
+.L60:
+	jmp	.L61
+	.section	.gcc_except_table
+.LLSDA41:
+	.byte	0xff
+	.byte	0xff
+	.byte	0x1
+	.uleb128 .LLSDACSE41-.LLSDACSB41
+.LLSDACSB41:
+	.uleb128 .LEHB19-.LFB41
+	.uleb128 .LEHE19-.LEHB19
+	.uleb128 0
+	.uleb128 0
+	.uleb128 .LEHB20-.LFB41
+	.uleb128 .LEHE20-.LEHB20
+	.uleb128 .L58-.LFB41
+	.uleb128 0
+	.uleb128 .LEHB21-.LFB41
+	.uleb128 .LEHE21-.LEHB21
+	.uleb128 .L60-.LFB41
+	.uleb128 0
+	.uleb128 .LEHB22-.LFB41
+	.uleb128 .LEHE22-.LEHB22
+	.uleb128 0
+	.uleb128 0
+	.uleb128 .LEHB23-.LFB41
+	.uleb128 .LEHE23-.LEHB23
+	.uleb128 .L58-.LFB41
+	.uleb128 0
+.LLSDACSE41:
+	.text
+	.cfi_endproc
+	.section	.text.unlikely
+	.cfi_startproc
+	.cfi_personality 0x9b,DW.ref.__gcc_personality_v0
+	.cfi_lsda 0x1b,.LLSDAC41
+	.type	early_return.cold, @function
+early_return.cold:
+.LFSB41:
+.L53:
+	.cfi_def_cfa_offset 48
+	.cfi_offset 3, -40
+	.cfi_offset 6, -32
+	.cfi_offset 12, -24
+	.cfi_offset 13, -16
+	movq	%rbx, %rdi
+.LEHB24:
+	call	cleanup_free@PLT
+.LEHE24:
+.L54:
+	movq	%r13, %rdi
+.LEHB25:
+	call	cleanup_fclose@PLT
+	movq	%rbp, %rdi
+	call	_Unwind_Resume@PLT
+.LEHE25:
+.L59:
+.L61:
+	movq	%rax, %rbp
+	jmp	.L54
+	.cfi_endproc
+.LFE41:
+	.section	.gcc_except_table
+.LLSDAC41:
+	.byte	0xff
+	.byte	0xff
+	.byte	0x1
+	.uleb128 .LLSDACSEC41-.LLSDACSBC41
+.LLSDACSBC41:
+	.uleb128 .LEHB24-.LCOLDB5
+	.uleb128 .LEHE24-.LEHB24
+	.uleb128 .L59-.LCOLDB5
+	.uleb128 0
+	.uleb128 .LEHB25-.LCOLDB5
+	.uleb128 .LEHE25-.LEHB25
+	.uleb128 0
+	.uleb128 0
+.LLSDACSEC41:
+	.section	.text.unlikely
+	.text
+	.size	early_return, .-early_return
+	.section	.text.unlikely
+	.size	early_return.cold, .-early_return.cold
+.LCOLDE5:
+	.text
+.LHOTE5:
+	.hidden	DW.ref.__gcc_personality_v0
+	.weak	DW.ref.__gcc_personality_v0
+	.section	.data.rel.local.DW.ref.__gcc_personality_v0,"awG",@progbits,DW.ref.__gcc_personality_v0,comdat
+	.align 8
+	.type	DW.ref.__gcc_personality_v0, @object
+	.size	DW.ref.__gcc_personality_v0, 8
+DW.ref.__gcc_personality_v0:
+	.quad	__gcc_personality_v0
+	.ident	"GCC: (Debian 12.2.0-14+deb12u1) 12.2.0"
+	.section	.note.GNU-stack,"",@progbits
@@ -0,0 +1,216 @@
+	.file	"snippets_defer.c"
+	.text
+	.p2align 4
+	.globl	one_free
+	.type	one_free, @function
+one_free:
+	pushq	%rbx
+	call	malloc@PLT
+	testq	%rax, %rax
+	je	.L3
+	movq	%rax, %rbx
+	movq	%rax, %rdi
+	call	consume@PLT
+	movq	%rbx, %rdi
+	call	cleanup_free@PLT
+	xorl	%eax, %eax
+	popq	%rbx
+	ret
+.L3:
+	orl	$-1, %eax
+	popq	%rbx
+	ret
+	.size	one_free, .-one_free
+	.section	.rodata.str1.1,"aMS",@progbits,1
+.LC0:
+	.string	"r"
+	.text
+	.p2align 4
+	.globl	one_fclose
+	.type	one_fclose, @function
+one_fclose:
+	pushq	%rbp
+	leaq	.LC0(%rip), %rsi
+	pushq	%rbx
+	subq	$8, %rsp
+	call	fopen@PLT
+	testq	%rax, %rax
+	je	.L8
+	movq	%rax, %rbx
+	movq	%rax, %rdi
+	call	fgetc@PLT
+	movq	%rbx, %rdi
+	movl	%eax, %ebp
+	call	cleanup_fclose@PLT
+.L6:
+	addq	$8, %rsp
+	movl	%ebp, %eax
+	popq	%rbx
+	popq	%rbp
+	ret
+.L8:
+	orl	$-1, %ebp
+	jmp	.L6
+	.size	one_fclose, .-one_fclose
+	.p2align 4
+	.globl	multiple
+	.type	multiple, @function
+multiple:
+	pushq	%r12
+	pushq	%rbp
+	pushq	%rbx
+	movq	%rdi, %rbx
+	call	malloc@PLT
+	testq	%rax, %rax
+	je	.L14
+	movq	%rbx, %rdi
+	movq	%rax, %rbp
+	call	malloc@PLT
+	movq	%rax, %r12
+	testq	%rax, %rax
+	je	.L15
+	movq	%rbx, %rdi
+	call	malloc@PLT
+	movq	%rax, %rbx
+	testq	%rax, %rax
+	je	.L16
+	movq	%rbp, %rdi
+	call	consume@PLT
+	movq	%r12, %rdi
+	call	consume@PLT
+	movq	%rbx, %rdi
+	call	consume@PLT
+	movq	%rbx, %rdi
+	xorl	%ebx, %ebx
+	call	cleanup_free@PLT
+.L13:
+	movq	%r12, %rdi
+	call	cleanup_free@PLT
+.L12:
+	movq	%rbp, %rdi
+	call	cleanup_free@PLT
+.L10:
+	movl	%ebx, %eax
+	popq	%rbx
+	popq	%rbp
+	popq	%r12
+	ret
+.L14:
+	orl	$-1, %ebx
+	jmp	.L10
+.L16:
+	orl	$-1, %ebx
+	jmp	.L13
+.L15:
+	orl	$-1, %ebx
+	jmp	.L12
+	.size	multiple, .-multiple
+	.p2align 4
+	.globl	nested
+	.type	nested, @function
+nested:
+	pushq	%r14
+	pushq	%r13
+	movl	%esi, %r13d
+	pushq	%r12
+	movq	%rdi, %r12
+	pushq	%rbp
+	pushq	%rbx
+	call	malloc@PLT
+	testq	%rax, %rax
+	je	.L23
+	movq	%rax, %r14
+	testl	%r13d, %r13d
+	jle	.L20
+	xorl	%ebp, %ebp
+	.p2align 4,,10
+	.p2align 3
+.L22:
+	movq	%r12, %rdi
+	call	malloc@PLT
+	movq	%rax, %rbx
+	movq	%rax, %rdi
+	call	consume@PLT
+	testq	%rbx, %rbx
+	je	.L21
+	movq	%rbx, %rdi
+	call	cleanup_free@PLT
+.L21:
+	addl	$1, %ebp
+	cmpl	%ebp, %r13d
+	jne	.L22
+.L20:
+	movq	%r14, %rdi
+	call	consume@PLT
+	movq	%r14, %rdi
+	call	cleanup_free@PLT
+	xorl	%eax, %eax
+.L18:
+	popq	%rbx
+	popq	%rbp
+	popq	%r12
+	popq	%r13
+	popq	%r14
+	ret
+.L23:
+	orl	$-1, %eax
+	jmp	.L18
+	.size	nested, .-nested
+	.p2align 4
+	.globl	early_return
+	.type	early_return, @function
+early_return:
+	pushq	%r13
+	pushq	%r12
+	movq	%rsi, %r12
+	leaq	.LC0(%rip), %rsi
+	pushq	%rbp
+	pushq	%rbx
+	subq	$8, %rsp
+	call	fopen@PLT
+	testq	%rax, %rax
+	je	.L33
+	movq	%r12, %rdi
+	movq	%rax, %rbp
+	call	malloc@PLT
+	movq	%rax, %rbx
+	testq	%rax, %rax
+	je	.L34
+	movq	%rbp, %rcx
+	movq	%r12, %rdx
+	movl	$1, %esi
+	movq	%rax, %rdi
+	call	fread@PLT
+	movl	$-3, %r13d
+	cmpq	%r12, %rax
+	je	.L37
+.L32:
+	movq	%rbx, %rdi
+	call	cleanup_free@PLT
+.L31:
+	movq	%rbp, %rdi
+	call	cleanup_fclose@PLT
+.L29:
+	addq	$8, %rsp
+	movl	%r13d, %eax
+	popq	%rbx
+	popq	%rbp
+	popq	%r12
+	popq	%r13
+	ret
+	.p2align 4,,10
+	.p2align 3
+.L37:
+	movq	%rbx, %rdi
+	xorl	%r13d, %r13d
+	call	consume@PLT
+	jmp	.L32
+.L34:
+	movl	$-2, %r13d
+	jmp	.L31
+.L33:
+	orl	$-1, %r13d
+	jmp	.L29
+	.size	early_return, .-early_return
+	.ident	"GCC: (Debian 12.2.0-14+deb12u1) 12.2.0"
+	.section	.note.GNU-stack,"",@progbits
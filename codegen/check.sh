@@ -0,0 +1,153 @@
+#!/bin/sh
+# Codegen regression check for defer.h, run by `make codegen-check`.
+#
+# For each available compiler, compiles snippets_defer.c and snippets_goto.c
+# at -O2 and compares every function after normalizing labels and registers.
+# The defer version must not call defer_cleanup or go through a function
+# pointer, and may not have more calls or instructions than its goto twin.
+# SLACK=n in the environment tolerates n extra instructions (default 0), for
+# compilers that schedule the two differently. Also reports .text bytes per
+# defer site from sites.c.
+#
+# Then compiles snippets_defer.c again with -fexceptions and compares the hot
+# section of each function against the plain build. Landing pads belong in
+# .text.unlikely: the hot path may not gain a call or an instruction besides
+# saving and restoring a callee-saved register, which carries the exception
+# through the cleanups, and the landing pads may not call defer_cleanup,
+# which would force the record onto the stack.
+#
+# Usage: [SLACK=n] codegen/check.sh <build_dir> [compiler...]
+
+BUILD_DIR=${1:-build}
+shift
+COMPILERS=${*:-"gcc clang"}
+DIR=$(dirname "$0")
+FLAGS="-O2 -fno-asynchronous-unwind-tables -fno-stack-protector -I$DIR/.."
+FUNCTIONS="one_free one_fclose multiple nested early_return"
+SLACK=${SLACK:-0}
+status=0
+
+# Normalize local labels and registers
+normalize() {
+    sed -e 's/\.L[0-9A-Z_]*/.L/g' -e 's/%[a-z0-9]*/%r/g'
+}
+
+# Drop callee-saved register saves and the stack adjustments around them
+unframed() {
+    grep -Ev '^[[:space:]]+((push|pop)q[[:space:]]+%(rbx|rbp|r1[2-5])|(sub|add)q[[:space:]]+\$[0-9]+, %rsp)$'
+}
+
+# Print the instructions of function $2 in assembly file $1
+body() {
+    awk -v fn="$2" '
+        $0 ~ "^" fn ":" { inside = 1; next }
+        inside && /^[a-zA-Z_][a-zA-Z0-9_]*:/ { inside = 0 }
+        inside && /^\t\.size/ { inside = 0 }
+        inside && !/^\t\./ && !/^\.L[A-Z]/ { print }
+    ' "$1"
+}
+
+# Like body, but stop where the function's cold part starts and leave out
+# landing pad stubs (labels named in .gcc_except_table, up to their jmp)
+hot() {
+    awk -v fn="$2" '
+        NR == FNR {
+            if ($1 == ".uleb128" && $2 ~ /^\.L[0-9]+-/) { split($2, lp, "-"); pad[lp[1] ":"] = 1 }
+            next
+        }
+        $0 ~ "^" fn ":" { inside = 1; next }
+        inside && /^[a-zA-Z_][a-zA-Z0-9_]*:/ { inside = 0 }
+        inside && /^\t\.(size|section)/ { inside = 0 }
+        inside && ($1 in pad) { skip = 1; next }
+        skip { if ($1 == "jmp") skip = 0; next }
+        inside && !/^\t\./ && !/^\.L[A-Z]/ { print }
+    ' "$1" "$1"
+}
+
+for cc in $COMPILERS; do
+    if ! command -v "$cc" >/dev/null 2>&1; then
+        echo "$cc: not found, skipped"
+        continue
+    fi
+    out="$BUILD_DIR/codegen-$cc"
+    mkdir -p "$out"
+    "$cc" $FLAGS -S -o "$out/defer.s" "$DIR/snippets_defer.c" || exit 1
+    "$cc" $FLAGS -S -o "$out/goto.s" "$DIR/snippets_goto.c" || exit 1
+
+    echo "== $cc -O2: defer vs goto (instructions / calls)"
+    for fn in $FUNCTIONS; do
+        body "$out/defer.s" "$fn" | normalize > "$out/$fn.defer"
+        body "$out/goto.s" "$fn" | normalize > "$out/$fn.goto"
+        di=$(grep -vc '^\.L' "$out/$fn.defer")
+        gi=$(grep -vc '^\.L' "$out/$fn.goto")
+        dc=$(grep -c 'call' "$out/$fn.defer")
+        gc=$(grep -c 'call' "$out/$fn.goto")
+        if cmp -s "$out/$fn.defer" "$out/$fn.goto"; then
+            verdict="identical"
+        elif grep -q 'call[a-z]*[[:space:]]*\*' "$out/$fn.defer" || grep -q 'defer_cleanup' "$out/$fn.defer"; then
+            verdict="FAIL: indirect or defer_cleanup call"
+        elif [ "$dc" -gt "$gc" ]; then
+            verdict="FAIL: extra call"
+        elif [ "$di" -gt $((gi + SLACK)) ]; then
+            verdict="FAIL: larger than goto"
+        elif [ "$di" -gt "$gi" ]; then
+            verdict="ok (+$((di - gi)) instructions)"
+        else
+            verdict="ok (different schedule)"
+        fi
+        printf '  %-14s %4s / %-3s %4s / %-3s %s\n' "$fn" "$di" "$dc" "$gi" "$gc" "$verdict"
+        case "$verdict" in
+            FAIL*)
+                diff "$out/$fn.goto" "$out/$fn.defer" | sed 's/^/    /'
+                status=1
+                ;;
+        esac
+    done
+
+    "$cc" $FLAGS -fexceptions -S -o "$out/defer-eh.s" "$DIR/snippets_defer.c" || exit 1
+    echo "== $cc -O2 -fexceptions: hot path vs plain build, without register saves (instructions / calls)"
+    for fn in $FUNCTIONS; do
+        hot "$out/defer-eh.s" "$fn" | unframed | normalize > "$out/$fn.eh"
+        body "$out/defer.s" "$fn" | unframed | normalize > "$out/$fn.plain"
+        hi=$(grep -vc '^\.L' "$out/$fn.eh")
+        hc=$(grep -c 'call' "$out/$fn.eh")
+        di=$(grep -vc '^\.L' "$out/$fn.plain")
+        dc=$(grep -c 'call' "$out/$fn.plain")
+        if awk -v fn="$fn" '$0 ~ "^" fn "(\\.cold)?:" { inside = 1; next }
+                /^[a-zA-Z_][a-zA-Z0-9_.]*:/ { inside = 0 }
+                inside && /call.*defer_cleanup/ { found = 1 }
+                END { exit !found }' "$out/defer-eh.s"; then
+            verdict="FAIL: landing pad calls defer_cleanup"
+        elif [ "$hc" -gt "$dc" ]; then
+            verdict="FAIL: extra call on the hot path"
+        elif [ "$hi" -gt $((di + SLACK)) ]; then
+            verdict="FAIL: hot path larger than plain build"
+        elif [ "$hi" -gt "$di" ]; then
+            verdict="ok (+$((hi - di)) instructions)"
+        else
+            verdict="ok"
+        fi
+        printf '  %-14s %4s / %-3s %4s / %-3s %s\n' "$fn" "$hi" "$hc" "$di" "$dc" "$verdict"
+        case "$verdict" in
+            FAIL*)
+                diff "$out/$fn.plain" "$out/$fn.eh" | sed 's/^/    /'
+                status=1
+                ;;
+        esac
+    done
+
+    "$cc" $FLAGS -c -o "$out/sites_defer.o" "$DIR/sites.c" || exit 1
+    "$cc" $FLAGS -DSITES_COMPACT -c -o "$out/sites_compact.o" "$DIR/sites.c" || exit 1
+    "$cc" $FLAGS -DSITES_GOTO -c -o "$out/sites_goto.o" "$DIR/sites.c" || exit 1
+    text() {
+        size -A "$1" | awk '$1 == ".text" { print $2 }'
+    }
+    base=$(text "$out/sites_goto.o")
+    echo "== $cc -O2: .text bytes per site vs goto (16 sites, goto total $base)"
+    for kind in defer compact; do
+        bytes=$(text "$out/sites_$kind.o")
+        awk -v k="$kind" -v b="$bytes" -v g="$base" \
+            'BEGIN { printf "  %-14s %+.1f bytes/site\n", k, (b - g) / 16 }'
+    done
+done
+exit $status
@@ -0,0 +1,47 @@
+/**
+ * @file sites.c
+ * @brief Code size of SITES cleanup sites in one function
+ *
+ * Built three ways by `make codegen-check`: with `defer_free`, with
+ * `defer_compact` and with goto-style cleanup (-DSITES_GOTO). The .text
+ * difference divided by SITES is the cost of one defer site.
+ */
+
+#include "../defer.h"
+
+#define SITES 16
+
+void consume(void* ptr);
+
+#ifdef SITES_COMPACT
+#define SITE(i) char* p##i = malloc(i + 1); defer_compact(defer_free_thunk, p##i); consume(p##i);
+#elif defined(SITES_GOTO)
+#define SITE(i) char* p##i = malloc(i + 1); consume(p##i);
+#define RELEASE(i) if (p##i) cleanup_free(p##i);
+#else
+#define SITE(i) char* p##i = malloc(i + 1); defer_free(p##i); consume(p##i);
+#endif
+
+// One site per line: defer names its record after __LINE__
+void sites(void) {
+    SITE(0)
+    SITE(1)
+    SITE(2)
+    SITE(3)
+    SITE(4)
+    SITE(5)
+    SITE(6)
+    SITE(7)
+    SITE(8)
+    SITE(9)
+    SITE(10)
+    SITE(11)
+    SITE(12)
+    SITE(13)
+    SITE(14)
+    SITE(15)
+#ifdef SITES_GOTO
+    RELEASE(15) RELEASE(14) RELEASE(13) RELEASE(12) RELEASE(11) RELEASE(10) RELEASE(9) RELEASE(8)
+    RELEASE(7) RELEASE(6) RELEASE(5) RELEASE(4) RELEASE(3) RELEASE(2) RELEASE(1) RELEASE(0)
+#endif
+}
@@ -0,0 +1,85 @@
+/**
+ * @file snippets_defer.c
+ * @brief Canonical defer usage compiled by `make codegen-check`
+ *
+ * Every function here has a hand-written goto-cleanup twin with the same
+ * name in snippets_goto.c. At -O2 both must compile to the same code.
+ */
+
+#include "../defer.h"
+
+void consume(void* ptr);
+
+int one_free(size_t size) {
+    char* buf = malloc(size);
+    defer_free(buf);
+    if (!buf) {
+        return -1;
+    }
+    consume(buf);
+    return 0;
+}
+
+int one_fclose(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    defer_fclose(file);
+    return fgetc(file);
+}
+
+int multiple(size_t size) {
+    char* a = malloc(size);
+    if (!a) {
+        return -1;
+    }
+    defer_free(a);
+    char* b = malloc(size);
+    if (!b) {
+        return -1;
+    }
+    defer_free(b);
+    char* c = malloc(size);
+    if (!c) {
+        return -1;
+    }
+    defer_free(c);
+    consume(a);
+    consume(b);
+    consume(c);
+    return 0;
+}
+
+int nested(size_t size, int rounds) {
+    char* outer = malloc(size);
+    defer_free(outer);
+    if (!outer) {
+        return -1;
+    }
+    for (int i = 0; i < rounds; i++) {
+        char* inner = malloc(size);
+        defer_free(inner);
+        consume(inner);
+    }
+    consume(outer);
+    return 0;
+}
+
+int early_return(const char* path, size_t size) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    defer_fclose(file);
+    char* buf = malloc(size);
+    defer_free(buf);
+    if (!buf) {
+        return -2;
+    }
+    if (fread(buf, 1, size, file) != size) {
+        return -3;
+    }
+    consume(buf);
+    return 0;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file snippets_goto.c
+ * @brief Goto-cleanup equivalents of snippets_defer.c
+ *
+ * Each function releases its resources through the same cleanup functions,
+ * with the same NULL checks, that the defer version schedules.
+ */
+
+#include "../defer.h"
+
+void consume(void* ptr);
+
+int one_free(size_t size) {
+    int result = 0;
+    char* buf = malloc(size);
+    if (!buf) {
+        result = -1;
+        goto out;
+    }
+    consume(buf);
+out:
+    if (buf) {
+        cleanup_free(buf);
+    }
+    return result;
+}
+
+int one_fclose(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    int result = fgetc(file);
+    cleanup_fclose(file);
+    return result;
+}
+
+int multiple(size_t size) {
+    int result = -1;
+    char* a = malloc(size);
+    if (!a) {
+        return -1;
+    }
+    char* b = malloc(size);
+    if (!b) {
+        goto free_a;
+    }
+    char* c = malloc(size);
+    if (!c) {
+        goto free_b;
+    }
+    consume(a);
+    consume(b);
+    consume(c);
+    result = 0;
+    cleanup_free(c);
+free_b:
+    cleanup_free(b);
+free_a:
+    cleanup_free(a);
+    return result;
+}
+
+int nested(size_t size, int rounds) {
+    char* outer = malloc(size);
+    if (!outer) {
+        return -1;
+    }
+    for (int i = 0; i < rounds; i++) {
+        char* inner = malloc(size);
+        consume(inner);
+        if (inner) {
+            cleanup_free(inner);
+        }
+    }
+    consume(outer);
+    cleanup_free(outer);
+    return 0;
+}
+
+int early_return(const char* path, size_t size) {
+    int result = 0;
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    char* buf = malloc(size);
+    if (!buf) {
+        result = -2;
+        goto close_file;
+    }
+    if (fread(buf, 1, size, file) != size) {
+        result = -3;
+        goto free_buf;
+    }
+    consume(buf);
+free_buf:
+    cleanup_free(buf);
+close_file:
+    cleanup_fclose(file);
+    return result;
+}
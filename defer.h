@@ -71,15 +71,170 @@
  * }
  * ```
  * 
+ * ## Compact Defers
+ * 
+ * ```c
+ * DEFER_COMPACT_THUNK(token_release_thunk, token_release)
+ * 
+ * void parse(parser_t* p) {
+ *     token_t* tok = next_token(p);
+ *     defer_compact(token_release_thunk, tok);  // Stack slot holds only tok
+ * }
+ * ```
+ * 
+ * ## Error Unwinding
+ * 
+ * ```c
+ * void parse_item(parser_t* p) {
+ *     char* buf = malloc(64);
+ *     defer_dynamic(free, buf);  // Runs on scope exit and when a throw passes
+ *     if (!read_item(p, buf)) defer_throw(EINVAL);
+ * }
+ * 
+ * defer_try {
+ *     parse_item(p);
+ * } defer_catch(err) {
+ *     fprintf(stderr, "parse failed: %d\n", err);
+ * }
+ * ```
+ * 
+ * `defer_try` and `defer_catch` expand to loops, so `break` and `continue`
+ * inside either block only leave that block; they never reach a loop
+ * around it. Set a flag and test it after the catch, or use `goto`.
+ * 
+ * ## C++ Exceptions
+ * 
+ * C built with `-fexceptions` runs its defers when a C++ exception unwinds
+ * through it, like destructors. Without the flag they are skipped.
+ * 
+ * ```c
+ * // Built with -fexceptions; on_record is a C++ function that may throw
+ * char* line = malloc(4096);
+ * defer_free(line);
+ * while (fgets(line, 4096, file)) on_record(line);
+ * ```
+ * 
+ * ## Streaming Large Files
+ * 
+ * ```c
+ * int scan(const char* path) {
+ *     defer_reader_t reader;
+ *     if (defer_reader_open(&reader, path, 0, 0) != 0) return -1;
+ *     defer_reader(&reader);
+ * 
+ *     const void* chunk;
+ *     ssize_t n;
+ *     while ((n = defer_reader_next(&reader, &chunk)) > 0) {
+ *         // Process chunk; pages behind the cursor are dropped from the page cache
+ *     }
+ *     return n < 0 ? -1 : 0;
+ * }
+ * ```
+ * 
+ * ## Buffered Writes
+ * 
+ * ```c
+ * int write_log(int fd, const struct iovec* records, int count) {
+ *     int status = 0;
+ *     {
+ *         defer_writer_t writer;
+ *         if (defer_writer_open(&writer, fd, 0, DEFER_WRITER_CLOSE) != 0) return -1;
+ *         writer.status = &status;
+ *         defer_writer(&writer);  // Flushes and closes, storing any errno in status
+ * 
+ *         defer_writer_writev(&writer, records, count);
+ *     }
+ *     return status;
+ * }
+ * ```
+ * 
+ * ## Structured Concurrency
+ * 
+ * ```c
+ * int checksum_all(const char** paths, int count) {
+ *     defer_nursery(nursery);  // Scope exit waits for every spawned task
+ *     for (int i = 0; i < count; i++) {
+ *         nursery_spawn(checksum_file, (void*)paths[i]);
+ *     }
+ *     return nursery_join(&nursery);  // Number of tasks that failed
+ * }
+ * ```
+ * 
+ * ## Fast Shutdown
+ * 
+ * ```c
+ * void on_sigterm(int sig) {
+ *     defer_set_exiting();  // From here on defer_free, defer_reclaimable and freeing/unmapping cleanups are no-ops
+ *     stop = 1;
+ * }
+ * 
+ * defer_reclaimable(unmap_arena, arena);  // Skipped while exiting
+ * defer_atexit(flush_journal, journal, 10);  // Runs before priority 0 entries
+ * ```
+ * 
  * # Configuration
  * 
  * - `DEFER_IMPLEMENTATION`: Define in one source file to get the implementation
+ * - `DEFER_COMPACT`: Make `defer_free` and `defer_fclose` use 8-byte compact defers
+ * - `DEFER_TRACE_FREE`: Print every pointer `defer_free` releases; 0 for hot paths (1)
+ * - `DEFER_READER_BUFSIZE`: Default chunk size of `defer_reader_t` (1 MiB)
+ * - `DEFER_READER_ALIGN`: Alignment of reader buffers, must suit O_DIRECT (4096)
+ * - `DEFER_WRITER_BUFSIZE`: Default buffer size of `defer_writer_t` (256 KiB)
+ * - `DEFER_FSYNC_MAX_BATCH`: Most descriptors flushed by one group commit (64)
+ * - `DEFER_PIPE_POOL`: Pipe pairs kept for splice() transfers (8)
+ * - `DEFER_WORKERS`: Worker threads of the nursery pool, 0 for one per CPU (0)
+ * - `DEFER_DEQUE_SIZE`: Capacity of each worker's task deque, a power of two (1024)
+ * - `DEFER_THREAD_EXIT_INLINE`: Thread-exit defers stored without allocating (16)
+ * - `DEFER_UNREF_SLOTS`: Per-thread buffered decrement slots, a power of two (64)
+ * - `DEFER_UNREF_BATCH`: Decrements buffered per object before merging (256)
+ * - `DEFER_TICK_SIZE`: Capacity of each tick ring and inbox, a power of two (1024)
+ * - `DEFER_POOL_AFFINITY`: Per-pool slots that cache a handle per thread (16)
+ * - `DEFER_HANDLE_CAPACITY`: Slots in the process-wide handle table (65536)
+ * - `DEFER_MAX_CPUS`: CPUs covered by the affinity mask `defer_pin_cpu` saves (1024)
+ * - `DEFER_MEM_PHASES`: Distinct phase names kept by the memory report (64)
+ * - `DEFER_ONCE_SLOTS`: Per-thread set of active `defer_once` pairs, a power of two (64)
+ * - `DEFER_HUGE_PAGE_SIZE`: Page size `defer_alloc_huge` maps and aligns to (2 MiB)
+ * - `DEFER_MLOCK_RANGES`: Ranges locked with `defer_mlock` at once, process-wide (128)
+ * 
+ * On Linux, build the implementation file with `_GNU_SOURCE` defined to enable
+ * the Linux-specific fast paths.
  */
 
 #ifndef DEFER_H
 #define DEFER_H
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include <fenv.h>
+
+#if !defined(_WIN32)
+#define DEFER_POSIX 1
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <dirent.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+#include <pthread.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/uio.h>
+#else
+#include <errno.h>
+#include <malloc.h>
+#endif
 
 #ifndef DEFER_FREE
 #define DEFER_FREE free
@@ -89,6 +244,28 @@
 #define DEFER_FCLOSE fclose
 #endif
 
+#ifndef DEFER_TRACE_FREE
+#define DEFER_TRACE_FREE 1
+#endif
+
+// Marks cleanups that never throw, so C built with -fexceptions (and C++)
+// emits no landing pad around them. Not used on cleanups that run callbacks
+// or user hooks (DEFER_FREE, DEFER_FCLOSE), nor on those reaching
+// cancellation points such as close() or fsync(): pthread_cancel unwinds
+// through those, and a nothrow frame would turn that into terminate.
+#define DEFER_NOTHROW __attribute__((nothrow))
+
+// Scope entry functions whose result is the only way to see a failure
+#if defined(__GNUC__)
+#define DEFER_MUST_USE __attribute__((warn_unused_result))
+#else
+#define DEFER_MUST_USE
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // Internal structure to hold the deferred function and its argument
 typedef struct {
     void (*func)(void*);
@@ -98,7 +275,659 @@ typedef struct {
 // Function declarations
 void cleanup_free(void* ptr);
 void cleanup_fclose(void* ptr);
-void defer_cleanup(defer_data_t* data);
+
+// Inline so an optimized defer compiles to a direct call of its cleanup.
+// Forced, so that with -fexceptions the landing pad calls the cleanup
+// directly and the record never has to be stored on the non-throwing path.
+static inline __attribute__((always_inline)) void defer_cleanup(defer_data_t* data) {
+    if (data && data->func && data->arg) {
+        data->func(data->arg);
+    }
+}
+
+// Process shutdown state. While set, reclaimable cleanups (heap frees,
+// unmaps) are skipped because the OS is about to take the memory back;
+// cleanups with external effects still run. Safe to set from a signal handler.
+int defer_exiting(void);
+void defer_set_exiting(void);
+void defer_cleanup_reclaimable(defer_data_t* data);
+
+// Scoped floating-point control. defer_fp_fast() enables flush-to-zero and
+// denormals-are-zero for SSE/AVX (MXCSR) or AArch64 (FPCR.FZ) arithmetic of
+// the calling thread; elsewhere it changes nothing and enter returns -1.
+// defer_fp_round(mode) sets an <fenv.h> rounding mode and needs -lm. Both
+// restore the saved modes at scope exit and keep exception flags raised
+// inside the scope. Inline, so programs not using them need no libm.
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE__))
+#define DEFER_FP_FAST_BITS 0x8040ULL  // MXCSR.FTZ | MXCSR.DAZ
+#define DEFER_FP_FLAG_BITS 0x3fULL    // Sticky exception flags
+static inline unsigned long long defer_fp_control(void) {
+    return __builtin_ia32_stmxcsr();
+}
+static inline void defer_fp_set_control(unsigned long long control) {
+    __builtin_ia32_ldmxcsr((unsigned int)control);
+}
+#elif defined(__aarch64__)
+#define DEFER_FP_FAST_BITS (1ULL << 24)  // FPCR.FZ
+#define DEFER_FP_FLAG_BITS 0ULL          // Flags live in FPSR
+static inline unsigned long long defer_fp_control(void) {
+    unsigned long long control;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(control));
+    return control;
+}
+static inline void defer_fp_set_control(unsigned long long control) {
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(control));
+}
+#endif
+
+typedef struct {
+    unsigned long long control;
+    int active;
+} defer_fp_fast_t;
+
+typedef struct {
+    fenv_t env;
+    int active;
+} defer_fp_round_t;
+
+static inline int defer_fp_fast_enter(defer_fp_fast_t* scope) {
+#ifdef DEFER_FP_FAST_BITS
+    scope->control = defer_fp_control();
+    scope->active = 1;
+    defer_fp_set_control(scope->control | DEFER_FP_FAST_BITS);
+    return 0;
+#else
+    scope->active = 0;
+    return -1;
+#endif
+}
+
+static inline void DEFER_NOTHROW cleanup_fp_fast(void* ptr) {
+#ifdef DEFER_FP_FAST_BITS
+    defer_fp_fast_t* scope = (defer_fp_fast_t*)ptr;
+    if (scope->active) {
+        unsigned long long flags = defer_fp_control() & DEFER_FP_FLAG_BITS;
+        defer_fp_set_control((scope->control & ~DEFER_FP_FLAG_BITS) | flags);
+        scope->active = 0;
+    }
+#else
+    (void)ptr;
+#endif
+}
+
+static inline int defer_fp_round_enter(defer_fp_round_t* scope, int mode) {
+    scope->active = fegetenv(&scope->env) == 0 && fesetround(mode) == 0;
+    return scope->active ? 0 : -1;
+}
+
+static inline void DEFER_NOTHROW cleanup_fp_round(void* ptr) {
+    defer_fp_round_t* scope = (defer_fp_round_t*)ptr;
+    if (scope->active) {
+        feupdateenv(&scope->env);
+        scope->active = 0;
+    }
+}
+
+// Error unwinding. defer_throw() jumps to the innermost defer_try and runs
+// every dynamic defer registered since it was entered, newest first.
+// Cleanup-attribute defers do not run on longjmp, so code a throw may cross
+// must use defer_dynamic(). Locals modified inside defer_try and read in
+// defer_catch must be volatile. Both blocks are loop bodies: break and
+// continue inside them leave the block, not an enclosing loop.
+#ifdef DEFER_POSIX
+typedef sigjmp_buf defer_jmp_buf;
+#define defer_setjmp(env) sigsetjmp(env, 0)
+#define defer_longjmp(env) siglongjmp(env, 1)
+#else
+typedef jmp_buf defer_jmp_buf;
+#define defer_setjmp(env) setjmp(env)
+#define defer_longjmp(env) longjmp(env, 1)
+#endif
+
+typedef struct defer_unwind {
+    struct defer_unwind* prev;
+    void (*func)(void*);
+    void* arg;
+} defer_unwind_t;
+
+typedef struct defer_try_frame {
+    struct defer_try_frame* prev;
+    defer_unwind_t* mark;  // Newest dynamic defer when the frame was entered
+    int error;
+    defer_jmp_buf env;
+} defer_try_frame_t;
+
+extern __thread defer_try_frame_t* defer_try_top;
+extern __thread defer_unwind_t* defer_unwind_top;
+
+void defer_throw(int error) __attribute__((noreturn));
+
+static inline defer_try_frame_t* defer_try_push(defer_try_frame_t* frame) {
+    frame->prev = defer_try_top;
+    frame->mark = defer_unwind_top;
+    frame->error = 0;
+    defer_try_top = frame;
+    return frame;
+}
+
+// Pops the frame on normal exit and when leaving defer_try through return or break
+static inline void defer_try_pop(defer_try_frame_t* frame) {
+    if (defer_try_top == frame) {
+        defer_try_top = frame->prev;
+    }
+}
+
+static inline void defer_unwind_push(defer_unwind_t* record) {
+    record->prev = defer_unwind_top;
+    defer_unwind_top = record;
+}
+
+static inline void defer_unwind_pop(defer_unwind_t* record) {
+    defer_unwind_top = record->prev;
+    if (record->func && record->arg) {
+        record->func(record->arg);
+    }
+}
+
+#ifndef DEFER_ONCE_SLOTS
+#define DEFER_ONCE_SLOTS 64
+#endif
+
+// Coalescing defer. The first defer_once(func, arg) on a thread owns the
+// pair; registering the same pair again while the owner is active does
+// nothing, so func(arg) runs once, when the outermost registering scope
+// exits. Active pairs live in a small per-thread open-addressing set; once
+// it is 3/4 full, new pairs run at their own scope exit instead. Owners are
+// dynamic defers, so defer_throw runs them too.
+typedef struct {
+    defer_unwind_t unwind;
+    void (*func)(void*);
+    void* arg;
+    int owner;
+    int keyed;  // The pair is in the set
+} defer_once_t;
+
+void defer_once_enter(defer_once_t* once, void (*func)(void*), void* arg);
+void cleanup_once(void* ptr);
+
+typedef enum {
+    DEFER_ALLOC_NONE,      // Allocation failed or was released
+    DEFER_ALLOC_ALIGNED,   // posix_memalign, or _aligned_malloc on Windows
+    DEFER_ALLOC_HUGETLB,   // MAP_HUGETLB mapping from the reserved pool
+    DEFER_ALLOC_THP,       // Huge-page aligned mapping advised MADV_HUGEPAGE
+    DEFER_ALLOC_PAGES      // Regular pages
+} defer_alloc_kind_t;
+
+// Memory released with the call that matches how it was obtained. `kind`
+// records the path taken, so callers can report it and the scope-exit
+// release unmaps or frees accordingly.
+typedef struct {
+    void* ptr;
+    size_t size;  // Bytes mapped, rounded up to the page size for mappings
+    defer_alloc_kind_t kind;
+} defer_alloc_t;
+
+// Returns alloc->ptr, NULL with errno set on failure. `align` is a power of
+// two; smaller than a pointer is rounded up.
+void* defer_alloc_aligned_enter(defer_alloc_t* alloc, size_t align, size_t size) DEFER_MUST_USE;
+void defer_alloc_release(defer_alloc_t* alloc);
+void cleanup_alloc(void* ptr) DEFER_NOTHROW;
+
+#ifdef DEFER_POSIX
+
+#ifndef DEFER_READER_BUFSIZE
+#define DEFER_READER_BUFSIZE (1024 * 1024)
+#endif
+
+#ifndef DEFER_READER_ALIGN
+#define DEFER_READER_ALIGN 4096
+#endif
+
+// Reader flags
+#define DEFER_READER_DIRECT     0x1  // Try O_DIRECT, fall back to buffered reads
+#define DEFER_READER_KEEP_CACHE 0x2  // Do not drop pages behind the cursor
+
+// Sequential reader over a raw fd. Chunks are read into two aligned buffers
+// alternately, so the chunk returned by the previous call stays valid.
+typedef struct {
+    int fd;
+    int flags;
+    unsigned char* buf[2];
+    size_t bufsize;
+    int cur;
+    off_t offset;   // File offset of the next read
+    off_t dropped;  // Page cache has been dropped below this offset
+    int eof;
+} defer_reader_t;
+
+int defer_reader_open(defer_reader_t* reader, const char* path, size_t bufsize, int flags);
+ssize_t defer_reader_next(defer_reader_t* reader, const void** data);
+int defer_reader_close(defer_reader_t* reader);
+void cleanup_reader(void* ptr);
+
+#ifndef DEFER_WRITER_BUFSIZE
+#define DEFER_WRITER_BUFSIZE (256 * 1024)
+#endif
+
+// Writer flags
+#define DEFER_WRITER_CLOSE 0x1  // Close the fd when the writer is closed
+
+// Single-owner buffered writer over a raw fd. There is no locking; a writer
+// must only be used by one thread at a time. Errors are sticky: after the
+// first failure every call returns -1 and `error` holds the errno.
+typedef struct {
+    int fd;
+    int flags;
+    unsigned char* buf;
+    size_t bufsize;
+    size_t len;
+    int error;    // First errno seen, 0 if none
+    int* status;  // If set, receives 0 or the errno when the scope exits
+} defer_writer_t;
+
+int defer_writer_open(defer_writer_t* writer, int fd, size_t bufsize, int flags);
+int defer_writer_write(defer_writer_t* writer, const void* data, size_t len);
+int defer_writer_writev(defer_writer_t* writer, const struct iovec* iov, int iovcnt);
+int defer_writer_flush(defer_writer_t* writer);
+int defer_writer_close(defer_writer_t* writer);
+void cleanup_writer(void* ptr);
+
+#ifndef DEFER_FSYNC_MAX_BATCH
+#define DEFER_FSYNC_MAX_BATCH 64
+#endif
+
+// Scope state of defer_fsync()
+typedef struct {
+    int fd;
+    int* status;  // If set, receives 0 or the errno of the flush
+} defer_fsync_t;
+
+// Group commit: concurrent callers are collected into a batch for up to
+// `window_us` microseconds, then one leader flushes every distinct fd in
+// the batch while the others wait for its result.
+void defer_fsync_config(long window_us, int datasync);
+int defer_fsync_commit(int fd);
+void cleanup_fsync(void* ptr);
+
+#ifndef DEFER_PIPE_POOL
+#define DEFER_PIPE_POOL 8
+#endif
+
+// Send `len` bytes of `in_path` starting at `offset` to `out_fd` without
+// copying through user space where the platform allows it (sendfile, then
+// splice through a pooled pipe pair, then read/write). A `len` of 0 sends
+// up to the end of the file. Returns the number of bytes sent or -1.
+ssize_t defer_sendfile(int out_fd, const char* in_path, off_t offset, size_t len);
+void cleanup_close(void* ptr);
+
+#ifndef DEFER_WORKERS
+#define DEFER_WORKERS 0
+#endif
+
+#ifndef DEFER_DEQUE_SIZE
+#define DEFER_DEQUE_SIZE 1024
+#endif
+
+// Task run by the nursery pool; a non-zero return value is an error
+typedef int (*defer_task_fn)(void* arg);
+
+typedef struct defer_task_error {
+    struct defer_task_error* next;
+    defer_task_fn fn;
+    void* arg;
+    int error;
+} defer_task_error_t;
+
+// Structured concurrency scope. Tasks spawned into a nursery run on a shared
+// work-stealing pool and the nursery's scope exit waits for all of them.
+typedef struct defer_nursery {
+    struct defer_nursery* parent;  // Nursery that was current when this one opened
+    long pending;                  // Spawned tasks that have not finished
+    int cancelled;
+    int failed;                    // Tasks that returned an error
+    int skipped;                   // Tasks dropped because of cancellation
+    defer_task_error_t* errors;    // Failed tasks, most recent first
+    pthread_mutex_t lock;          // Protects errors
+} defer_nursery_t;
+
+void defer_nursery_begin(defer_nursery_t* nursery);
+int nursery_spawn(defer_task_fn fn, void* arg);
+int nursery_spawn_in(defer_nursery_t* nursery, defer_task_fn fn, void* arg);
+int nursery_join(defer_nursery_t* nursery);
+void nursery_cancel(defer_nursery_t* nursery);
+int nursery_cancelled(void);
+void cleanup_nursery(void* ptr);
+void defer_workers_shutdown(void);
+
+#ifndef DEFER_THREAD_EXIT_INLINE
+#define DEFER_THREAD_EXIT_INLINE 16
+#endif
+
+// Run func(arg) when the calling thread exits, in reverse registration order.
+// All registrations of a thread share one pthread key.
+int defer_thread_exit(void (*func)(void*), void* arg);
+void defer_thread_exit_run(void);
+
+// Run func(arg) at process exit. Higher priorities run first, equal
+// priorities in reverse registration order; defer_exiting() is already set.
+int defer_atexit(void (*func)(void*), void* arg, int priority);
+
+#ifndef DEFER_UNREF_SLOTS
+#define DEFER_UNREF_SLOTS 64
+#endif
+
+#ifndef DEFER_UNREF_BATCH
+#define DEFER_UNREF_BATCH 256
+#endif
+
+// Biased reference count. The owning thread counts with plain arithmetic;
+// other threads use the shared count, and their releases are buffered per
+// thread and merged in batches. dtor(obj) runs once both counts drain.
+// The owning thread must release its references before it exits.
+typedef struct defer_ref {
+    uintptr_t owner;          // Owner's merge queue, 0 once merged
+    long biased;              // Owner-only count
+    long shared;              // Other threads' count << 2 | QUEUED | MERGED
+    struct defer_ref* next;   // Owner merge queue link
+    void (*dtor)(void*);
+    void* obj;
+} defer_ref_t;
+
+#define DEFER_REF_MERGED 1L
+#define DEFER_REF_QUEUED 2L
+
+void defer_ref_init(defer_ref_t* ref, void (*dtor)(void*), void* obj);
+void defer_ref_acquire(defer_ref_t* ref);
+void defer_ref_release(defer_ref_t* ref);
+void defer_unref_flush(void);
+void cleanup_unref(void* ptr);
+
+#ifndef DEFER_TICK_SIZE
+#define DEFER_TICK_SIZE 1024
+#endif
+
+typedef struct {
+    size_t seq;
+    defer_data_t data;
+} defer_tick_cell_t;
+
+// Callbacks deferred to the next tick of an event loop. The loop's own
+// thread appends to a plain ring; other threads go through a bounded
+// MPSC inbox. Both are fixed-size, so queueing never allocates. Ticks
+// nest: cleanup_tick makes the tick that was current before init current
+// again.
+typedef struct defer_tick {
+    uintptr_t owner;                           // Thread that runs the loop
+    struct defer_tick* prev;                   // Current tick before init
+    size_t head;                               // Local ring, owner only
+    size_t tail;
+    size_t inbox_head;                         // Consumer position, owner only
+    char pad[64];
+    size_t inbox_tail;                         // Producer position, shared
+    defer_data_t ring[DEFER_TICK_SIZE];
+    defer_tick_cell_t inbox[DEFER_TICK_SIZE];
+} defer_tick_t;
+
+void defer_tick_init(defer_tick_t* tick);
+int defer_to_tick(void (*func)(void*), void* arg);
+int defer_to_tick_in(defer_tick_t* tick, void (*func)(void*), void* arg);
+size_t defer_tick_run(void);
+size_t defer_tick_run_in(defer_tick_t* tick);
+void cleanup_tick(void* ptr);
+
+#ifndef DEFER_POOL_AFFINITY
+#define DEFER_POOL_AFFINITY 16
+#endif
+
+typedef struct {
+    void* (*create)(void* ctx);                 // Returns NULL on failure
+    void (*destroy)(void* handle, void* ctx);   // Also called for evicted handles
+    int (*validate)(void* handle, void* ctx);   // Optional; non-zero drops the handle
+    void* ctx;
+    int max_handles;
+    long idle_timeout_ms;                       // Evict handles idle this long, 0 to keep
+} defer_pool_config_t;
+
+typedef struct {
+    void* handle;
+    long idle_since_ms;
+} defer_pool_idle_t;
+
+// Pool of expensive handles. Returned handles go to the releasing thread's
+// affinity slot when it is free, otherwise onto a LIFO idle stack.
+typedef struct {
+    defer_pool_config_t config;
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+    defer_pool_idle_t* idle;  // Ring; the top of the stack is the newest entry
+    int idle_head;
+    int idle_count;
+    int total;                // Handles created and not destroyed
+    int waiters;
+    void* affinity[DEFER_POOL_AFFINITY];
+    long affinity_since_ms[DEFER_POOL_AFFINITY];
+} defer_pool_t;
+
+typedef struct {
+    defer_pool_t* pool;
+    void* handle;
+} defer_lease_t;
+
+int defer_pool_init(defer_pool_t* pool, const defer_pool_config_t* config);
+void defer_pool_destroy(defer_pool_t* pool);
+void* defer_pool_acquire(defer_pool_t* pool, long timeout_ms);
+void defer_pool_release(defer_pool_t* pool, void* handle);
+void defer_pool_discard(defer_pool_t* pool, void* handle);
+int defer_pool_evict(defer_pool_t* pool);
+void cleanup_lease(void* ptr);
+
+#ifndef DEFER_HANDLE_CAPACITY
+#define DEFER_HANDLE_CAPACITY 65536
+#endif
+
+// Generational handle: generation in the high 32 bits, slot index in the low
+// 32. Live generations are odd, so 0 is never a valid handle.
+typedef uint64_t defer_handle_t;
+
+typedef struct {
+    uint32_t generation;     // Odd while the slot is live
+    uint32_t next_free;      // Free list link, index + 1
+    void* object;
+    void (*dtor)(void*);
+} defer_handle_slot_t;
+
+defer_handle_t defer_handle_alloc(void* object, void (*dtor)(void*));
+void* defer_handle_get(defer_handle_t handle);
+int defer_handle_release(defer_handle_t handle);
+size_t defer_handle_each(void (*func)(defer_handle_t handle, void* object, void* ctx), void* ctx);
+void cleanup_handle(void* ptr);
+
+#ifndef DEFER_MAX_CPUS
+#define DEFER_MAX_CPUS 1024
+#endif
+
+// Scoped CPU affinity, scheduling and memory locking. Each scope saves the
+// current state, applies the new one and restores exactly the saved state at
+// scope exit, so scopes nest. Affinity and scheduling apply to the calling
+// thread. A scope that failed to apply restores nothing; the _status macros
+// receive 0 or the errno of applying it.
+typedef struct {
+    int active;
+    unsigned long mask[DEFER_MAX_CPUS / (8 * sizeof(unsigned long))];
+} defer_affinity_t;
+
+typedef struct {
+    int active;
+    int policy;
+    struct sched_param param;
+} defer_sched_t;
+
+typedef struct {
+    int active;
+} defer_memlock_t;
+
+int defer_pin_cpu_enter(defer_affinity_t* scope, int cpu, int* status);
+void cleanup_affinity(void* ptr) DEFER_NOTHROW;
+int defer_sched_enter(defer_sched_t* scope, int policy, int priority, int* status);
+void cleanup_sched(void* ptr) DEFER_NOTHROW;
+// mlockall() is process-wide: the outermost section locks with its flags and
+// the last one to exit restores the state it found. Nested sections must
+// pass the same flags or fail with EBUSY. Locks the process held before the
+// outermost section (its own mlock() calls, an earlier mlockall, MCL_FUTURE)
+// are read from VmLck in /proc/self/status; if there were any, everything
+// stays locked when the section ends, since munlockall() cannot tell them
+// apart. Without /proc the process is assumed to hold no locks beforehand.
+int defer_mlockall_enter(defer_memlock_t* scope, int flags, int* status);
+void cleanup_mlockall(void* ptr) DEFER_NOTHROW;
+
+#ifndef DEFER_MLOCK_RANGES
+#define DEFER_MLOCK_RANGES 128
+#endif
+
+// Scoped mlock() of the pages covering a range; mlock faults every page in,
+// so the range is also prefaulted. Locks do not stack in the kernel, so
+// locked pages are reference counted in a process-wide list of page-range
+// segments, and a page is unlocked only when the last scope covering it
+// exits. New pages are charged against RLIMIT_MEMLOCK, read at each call,
+// on top of everything the process has locked according to VmLck, so other
+// mlock() calls and mlockall count too; over it the scope fails with ENOMEM.
+// New pages the caller already locked itself are counted twice, and without
+// /proc only defer_mlock's own pages count. The budget applies even with
+// CAP_IPC_LOCK, which lifts the kernel's limit. Inside a defer_mlockall
+// section nothing is unlocked early, and ranges still held are locked again
+// when the section ends.
+typedef struct {
+    int active;
+    uintptr_t start;  // Page-aligned bounds
+    uintptr_t end;
+} defer_mlock_t;
+
+int defer_mlock_enter(defer_mlock_t* scope, const void* ptr, size_t len, int* status);
+void cleanup_mlock(void* ptr) DEFER_NOTHROW;
+// Bytes currently locked through defer_mlock
+size_t defer_mlock_locked(void);
+
+#ifndef DEFER_MEM_PHASES
+#define DEFER_MEM_PHASES 64
+#endif
+
+// Per-phase memory accounting. Memory from defer_mem_malloc/defer_mem_realloc
+// carries its size in a 16-byte header and must be released with
+// defer_mem_free; define DEFER_FREE as defer_mem_free to route defer_free()
+// through it. Bytes are counted per thread, charged to the thread that
+// allocates or frees them, and attributed to the innermost defer_mem_scope.
+// Phase names are kept by pointer, so pass string literals.
+typedef struct defer_mem_scope {
+    struct defer_mem_scope* prev;
+    const char* name;
+    size_t trim_bytes;         // Purge at exit once the phase freed this much, 0 never
+    long long live_base;       // Thread counters at entry
+    long long allocated_base;
+    long long freed_base;
+    long long peak;            // Highest live bytes above live_base seen inside
+} defer_mem_scope_t;
+
+void* defer_mem_malloc(size_t size);
+void* defer_mem_realloc(void* ptr, size_t size);
+void defer_mem_free(void* ptr);
+void defer_mem_scope_enter(defer_mem_scope_t* scope, const char* name, size_t trim_bytes);
+void cleanup_mem_scope(void* ptr);
+// Called instead of malloc_trim() when a phase crosses its trim threshold
+void defer_mem_set_purge(void (*purge)(void* ctx), void* ctx);
+// Peak bytes of the calling thread's innermost phase so far, or -1 outside one
+long long defer_mem_peak(void);
+// One line per phase name, highest peak first
+void defer_mem_report(FILE* out);
+
+// Shared-memory segment. defer_shm_create() with a name makes a new POSIX
+// shared memory object (failing if it exists) and owns it: closing unlinks
+// the name. Without a name it makes an anonymous segment (memfd on Linux)
+// to share across fork() or by passing the fd. defer_shm_open() maps an
+// existing named segment without owning it.
+typedef struct {
+    void* addr;
+    size_t size;
+    int fd;
+    int owner;
+    char name[64];
+} defer_shm_t;
+
+int defer_shm_create(defer_shm_t* shm, const char* name, size_t size);
+int defer_shm_open(defer_shm_t* shm, const char* name);
+int defer_shm_close(defer_shm_t* shm);
+void cleanup_shm(void* ptr);
+
+// Single-producer single-consumer message ring laid out in shared memory.
+// Producer and consumer state sit on separate cache lines, each with a
+// cached copy of the other side's position. Messages are written and read
+// in place: reserve/commit on the producer side, peek/release on the
+// consumer side. Calls return NULL with EAGAIN when full or empty.
+typedef struct {
+    uint64_t magic;
+    uint64_t capacity;      // Data bytes, a power of two
+    char pad0[64 - 2 * sizeof(uint64_t)];
+    uint64_t head;          // Producer position
+    uint64_t tail_cache;    // Producer's copy of tail
+    char pad1[64 - 2 * sizeof(uint64_t)];
+    uint64_t tail;          // Consumer position
+    uint64_t head_cache;    // Consumer's copy of head
+    char pad2[64 - 2 * sizeof(uint64_t)];
+    unsigned char data[];
+} defer_ring_t;
+
+// Bytes of shared memory a ring needs for `capacity` data bytes
+size_t defer_ring_bytes(size_t capacity);
+// Formats a ring in `size` bytes at `mem`, using the largest power of two
+// that fits; the other side attaches to the same memory
+defer_ring_t* defer_ring_init(void* mem, size_t size);
+defer_ring_t* defer_ring_attach(void* mem);
+// Largest message a ring accepts
+size_t defer_ring_max_message(const defer_ring_t* ring);
+void* defer_ring_reserve(defer_ring_t* ring, size_t len);
+void defer_ring_commit(defer_ring_t* ring);
+const void* defer_ring_peek(defer_ring_t* ring, size_t* len);
+void defer_ring_release(defer_ring_t* ring);
+
+// Anonymous temp file: an O_TMPFILE descriptor in `dir` that has no name and
+// vanishes on close, even after a crash. Without O_TMPFILE it falls back to
+// mkstemp() plus an immediate unlink. defer_tmpfile_link() gives the file a
+// name atomically, replacing `path` if it exists, through a randomly named
+// link next to it that is retried on EEXIST; it needs O_TMPFILE and /proc
+// and fails with ENOENT on the fallback.
+int defer_tmpfile_open(const char* dir);
+int defer_tmpfile_link(int fd, const char* path);
+
+// Temp directory removed with everything in it at scope exit. Removal works
+// through the held descriptors (openat/unlinkat), so it never re-resolves
+// the path and does not follow symlinks.
+typedef struct {
+    int fd;              // The directory, for openat() and friends
+    int parent_fd;
+    char name[32];       // Entry name inside the parent
+    char path[PATH_MAX];
+} defer_tmpdir_t;
+
+// `parent` may be NULL for $TMPDIR or /tmp
+int defer_tmpdir_create(defer_tmpdir_t* dir, const char* parent);
+int defer_tmpdir_remove(defer_tmpdir_t* dir);
+void cleanup_tmpdir(void* ptr);
+
+#ifndef DEFER_HUGE_PAGE_SIZE
+#define DEFER_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#endif
+
+// Huge-page backed memory for large tables. Tries a MAP_HUGETLB mapping,
+// then a huge-page aligned mapping advised MADV_HUGEPAGE so transparent huge
+// pages can back it, then regular pages. The size is rounded up to
+// DEFER_HUGE_PAGE_SIZE and the memory is zeroed. Returns alloc->ptr, NULL
+// with errno set on failure.
+void* defer_alloc_huge_enter(defer_alloc_t* alloc, size_t size) DEFER_MUST_USE;
+
+#endif // DEFER_POSIX
+
+#ifdef __cplusplus
+}
+#endif
 
 #define DEFER_CONCAT_(a, b) a##b
 #define DEFER_CONCAT(a, b) DEFER_CONCAT_(a, b)
@@ -112,16 +941,143 @@ void defer_cleanup(defer_data_t* data);
         __attribute__((cleanup(defer_cleanup))) \
         defer_data_t DEFER_CONCAT(__defer_data_, __LINE__) = { (void (*)(void*))func, arg }
 
+    #define defer_reclaimable(func, arg) \
+        __attribute__((cleanup(defer_cleanup_reclaimable))) \
+        defer_data_t DEFER_CONCAT(__defer_data_, __LINE__) = { (void (*)(void*))func, arg }
+
+    // Compact defers bind the cleanup function at compile time through a
+    // per-function thunk, so the stack slot holds only the 8-byte argument
+    #define DEFER_COMPACT_THUNK(name, func) \
+        static inline void name(void** slot) { \
+            if (*slot) { \
+                func(*slot); \
+            } \
+        }
+
+    #define defer_compact(thunk, arg) \
+        __attribute__((cleanup(thunk))) \
+        void* DEFER_CONCAT(__defer_arg_, __LINE__) = (void*)(arg)
+
+    DEFER_COMPACT_THUNK(defer_free_thunk, cleanup_free)
+    DEFER_COMPACT_THUNK(defer_fclose_thunk, cleanup_fclose)
+
+    #define defer_dynamic(func, arg) \
+        __attribute__((cleanup(defer_unwind_pop))) \
+        defer_unwind_t DEFER_CONCAT(__defer_unwind_, __LINE__) = { NULL, (void (*)(void*))func, arg }; \
+        defer_unwind_push(&DEFER_CONCAT(__defer_unwind_, __LINE__))
+
+    #define defer_once(func, arg) \
+        defer_once_t DEFER_CONCAT(__defer_once_, __LINE__); \
+        defer_once_enter(&DEFER_CONCAT(__defer_once_, __LINE__), (void (*)(void*))func, arg); \
+        defer(cleanup_once, &DEFER_CONCAT(__defer_once_, __LINE__))
+
+    // Built from for loops so the frame is pushed before and popped after the
+    // block. A break or continue in the try or catch block therefore ends
+    // that block only and never affects a loop the defer_try sits in.
+    #define defer_try \
+        for (defer_try_frame_t __defer_try_frame __attribute__((cleanup(defer_try_pop))), \
+             *volatile __defer_try_run = defer_try_push(&__defer_try_frame); \
+             __defer_try_run; __defer_try_run = NULL) \
+            if (defer_setjmp(__defer_try_frame.env) == 0) \
+                for (; __defer_try_run; defer_try_pop(&__defer_try_frame), __defer_try_run = NULL)
+
+    #define defer_catch(err) \
+            else \
+                for (int err = __defer_try_frame.error; __defer_try_run; __defer_try_run = NULL)
+
+#ifdef DEFER_COMPACT
+    #define defer_free(ptr) defer_compact(defer_free_thunk, ptr)
+    #define defer_fclose(fp) defer_compact(defer_fclose_thunk, fp)
+#else
     #define defer_free(ptr) defer(cleanup_free, ptr)
     #define defer_fclose(fp) defer(cleanup_fclose, fp)
 #endif
+    #define defer_fp_fast() \
+        defer_fp_fast_t DEFER_CONCAT(__defer_fp_fast_, __LINE__); \
+        defer_fp_fast_enter(&DEFER_CONCAT(__defer_fp_fast_, __LINE__)); \
+        defer(cleanup_fp_fast, &DEFER_CONCAT(__defer_fp_fast_, __LINE__))
+    #define defer_fp_round(mode) \
+        defer_fp_round_t DEFER_CONCAT(__defer_fp_round_, __LINE__); \
+        defer_fp_round_enter(&DEFER_CONCAT(__defer_fp_round_, __LINE__), (mode)); \
+        defer(cleanup_fp_round, &DEFER_CONCAT(__defer_fp_round_, __LINE__))
+    #define defer_reader(reader) defer(cleanup_reader, reader)
+    #define defer_writer(writer) defer(cleanup_writer, writer)
+    #define defer_fsync_status(fd, status_ptr) \
+        defer_fsync_t DEFER_CONCAT(__defer_fsync_, __LINE__) = { (fd), (status_ptr) }; \
+        defer(cleanup_fsync, &DEFER_CONCAT(__defer_fsync_, __LINE__))
+    #define defer_fsync(fd) defer_fsync_status(fd, NULL)
+    #define defer_close(fd_ptr) defer(cleanup_close, fd_ptr)
+    #define defer_nursery(name) \
+        defer_nursery_t name; \
+        defer_nursery_begin(&name); \
+        defer(cleanup_nursery, &name)
+    #define defer_unref(ref) defer(cleanup_unref, ref)
+    #define defer_tick(tick) defer(cleanup_tick, tick)
+    #define defer_checkout(pool, handle_ptr, timeout_ms) \
+        defer_lease_t DEFER_CONCAT(__defer_lease_, __LINE__) = { (pool), NULL }; \
+        DEFER_CONCAT(__defer_lease_, __LINE__).handle = *(handle_ptr) = defer_pool_acquire((pool), (timeout_ms)); \
+        defer(cleanup_lease, &DEFER_CONCAT(__defer_lease_, __LINE__))
+    #define defer_handle(handle_ptr) defer(cleanup_handle, handle_ptr)
+    #define defer_pin_cpu_status(cpu, status_ptr) \
+        defer_affinity_t DEFER_CONCAT(__defer_affinity_, __LINE__); \
+        defer_pin_cpu_enter(&DEFER_CONCAT(__defer_affinity_, __LINE__), (cpu), (status_ptr)); \
+        defer(cleanup_affinity, &DEFER_CONCAT(__defer_affinity_, __LINE__))
+    #define defer_pin_cpu(cpu) defer_pin_cpu_status(cpu, NULL)
+    #define defer_sched_status(policy, priority, status_ptr) \
+        defer_sched_t DEFER_CONCAT(__defer_sched_, __LINE__); \
+        defer_sched_enter(&DEFER_CONCAT(__defer_sched_, __LINE__), (policy), (priority), (status_ptr)); \
+        defer(cleanup_sched, &DEFER_CONCAT(__defer_sched_, __LINE__))
+    #define defer_sched(policy, priority) defer_sched_status(policy, priority, NULL)
+    #define defer_mlockall_status(flags, status_ptr) \
+        defer_memlock_t DEFER_CONCAT(__defer_memlock_, __LINE__); \
+        defer_mlockall_enter(&DEFER_CONCAT(__defer_memlock_, __LINE__), (flags), (status_ptr)); \
+        defer(cleanup_mlockall, &DEFER_CONCAT(__defer_memlock_, __LINE__))
+    #define defer_mlockall(flags) defer_mlockall_status(flags, NULL)
+    #define defer_mlock_status(ptr, len, status_ptr) \
+        defer_mlock_t DEFER_CONCAT(__defer_mlock_, __LINE__); \
+        defer_mlock_enter(&DEFER_CONCAT(__defer_mlock_, __LINE__), (ptr), (len), (status_ptr)); \
+        defer(cleanup_mlock, &DEFER_CONCAT(__defer_mlock_, __LINE__))
+    #define defer_mlock(ptr, len) defer_mlock_status(ptr, len, NULL)
+    #define defer_mem_scope_trim(name, trim_bytes) \
+        defer_mem_scope_t DEFER_CONCAT(__defer_mem_scope_, __LINE__); \
+        defer_mem_scope_enter(&DEFER_CONCAT(__defer_mem_scope_, __LINE__), (name), (trim_bytes)); \
+        defer(cleanup_mem_scope, &DEFER_CONCAT(__defer_mem_scope_, __LINE__))
+    #define defer_mem_scope(name) defer_mem_scope_trim(name, 0)
+    #define defer_shm(shm) defer(cleanup_shm, shm)
+    #define defer_tmpfile(fd_ptr, dir) \
+        *(fd_ptr) = defer_tmpfile_open(dir); \
+        defer(cleanup_close, fd_ptr)
+    #define defer_tmpdir(dir_ptr, parent) \
+        defer_tmpdir_create((dir_ptr), (parent)); \
+        defer(cleanup_tmpdir, dir_ptr)
+    // Use as an initializer, `char* p = defer_alloc_aligned(...)`, and check p;
+    // ignoring the result draws a warning
+    #define defer_alloc_aligned(alloc_ptr, align, size) \
+        defer_alloc_aligned_enter((alloc_ptr), (align), (size)); \
+        defer(cleanup_alloc, alloc_ptr)
+    #define defer_alloc_huge(alloc_ptr, size) \
+        defer_alloc_huge_enter((alloc_ptr), (size)); \
+        defer(cleanup_alloc, alloc_ptr)
+#endif
 
 #ifdef DEFER_IMPLEMENTATION
 
+static int defer_exiting_flag = 0;
+
+int defer_exiting(void) {
+    return __atomic_load_n(&defer_exiting_flag, __ATOMIC_RELAXED);
+}
+
+void defer_set_exiting(void) {
+    __atomic_store_n(&defer_exiting_flag, 1, __ATOMIC_RELAXED);
+}
+
 // Function implementations
 void cleanup_free(void* ptr) {
-    if (ptr) {
+    if (ptr && !defer_exiting()) {
+#if DEFER_TRACE_FREE
         printf("Cleaning up free: %p\n", ptr);
+#endif
         DEFER_FREE(ptr);
     }
 }
@@ -132,12 +1088,2776 @@ void cleanup_fclose(void* ptr) {
     }
 }
 
-void defer_cleanup(defer_data_t* data) {
-    if (data && data->func && data->arg) {
-        data->func(data->arg);
+void defer_cleanup_reclaimable(defer_data_t* data) {
+    if (!defer_exiting()) {
+        defer_cleanup(data);
+    }
+}
+
+__thread defer_try_frame_t* defer_try_top = NULL;
+__thread defer_unwind_t* defer_unwind_top = NULL;
+
+void defer_throw(int error) {
+    defer_try_frame_t* frame = defer_try_top;
+    if (!frame) {
+        fprintf(stderr, "defer_throw(%d) outside defer_try\n", error);
+        abort();
+    }
+    // Run the dynamic defers of the frames being skipped while their stack is intact
+    while (defer_unwind_top != frame->mark) {
+        defer_unwind_pop(defer_unwind_top);
+    }
+    defer_try_top = frame->prev;
+    frame->error = error;
+    defer_longjmp(frame->env);
+}
+
+static __thread struct {
+    void (*func)(void*);
+    void* arg;
+} defer_once_set[DEFER_ONCE_SLOTS];
+static __thread int defer_once_count = 0;
+
+static size_t defer_once_slot(void (*func)(void*), void* arg) {
+    size_t hash = ((size_t)func ^ ((size_t)arg * 0x9e3779b97f4a7c15ULL)) * 0x9e3779b97f4a7c15ULL;
+    return (hash >> 32) & (DEFER_ONCE_SLOTS - 1);
+}
+
+// Runs through the unwind record, on scope exit or when a throw passes
+static void defer_once_run(void* ptr) {
+    defer_once_t* once = (defer_once_t*)ptr;
+    once->owner = 0;
+    if (once->keyed) {
+        // Remove the pair, shifting later entries of its probe run back
+        size_t i = defer_once_slot(once->func, once->arg);
+        while (defer_once_set[i].func != once->func || defer_once_set[i].arg != once->arg) {
+            i = (i + 1) & (DEFER_ONCE_SLOTS - 1);
+        }
+        for (size_t j = (i + 1) & (DEFER_ONCE_SLOTS - 1); defer_once_set[j].func; j = (j + 1) & (DEFER_ONCE_SLOTS - 1)) {
+            size_t home = defer_once_slot(defer_once_set[j].func, defer_once_set[j].arg);
+            // Move j into the hole unless its home lies cyclically in (i, j]
+            if (((j - home) & (DEFER_ONCE_SLOTS - 1)) >= ((j - i) & (DEFER_ONCE_SLOTS - 1))) {
+                defer_once_set[i] = defer_once_set[j];
+                i = j;
+            }
+        }
+        defer_once_set[i].func = NULL;
+        defer_once_set[i].arg = NULL;
+        defer_once_count--;
+    }
+    once->func(once->arg);
+}
+
+void defer_once_enter(defer_once_t* once, void (*func)(void*), void* arg) {
+    once->func = func;
+    once->arg = arg;
+    once->owner = 0;
+    once->keyed = 0;
+    if (!func || !arg) {
+        return;
+    }
+    size_t i = defer_once_slot(func, arg);
+    for (; defer_once_set[i].func; i = (i + 1) & (DEFER_ONCE_SLOTS - 1)) {
+        if (defer_once_set[i].func == func && defer_once_set[i].arg == arg) {
+            return;  // An outer scope already owns the pair
+        }
     }
+    if (defer_once_count < DEFER_ONCE_SLOTS * 3 / 4) {
+        defer_once_set[i].func = func;
+        defer_once_set[i].arg = arg;
+        defer_once_count++;
+        once->keyed = 1;
+    }
+    once->owner = 1;
+    once->unwind.func = defer_once_run;
+    once->unwind.arg = once;
+    defer_unwind_push(&once->unwind);
 }
 
+void cleanup_once(void* ptr) {
+    defer_once_t* once = (defer_once_t*)ptr;
+    if (once->owner) {
+        defer_unwind_pop(&once->unwind);
+    }
+}
+
+void* defer_alloc_aligned_enter(defer_alloc_t* alloc, size_t align, size_t size) {
+    alloc->ptr = NULL;
+    alloc->size = size;
+    alloc->kind = DEFER_ALLOC_NONE;
+    if (align < sizeof(void*)) {
+        align = sizeof(void*);
+    }
+    if (align & (align - 1)) {
+        errno = EINVAL;
+        return NULL;
+    }
+#ifdef _WIN32
+    alloc->ptr = _aligned_malloc(size ? size : 1, align);
+    if (!alloc->ptr) {
+        return NULL;
+    }
+#else
+    int error = posix_memalign(&alloc->ptr, align, size ? size : 1);
+    if (error != 0) {
+        alloc->ptr = NULL;
+        errno = error;
+        return NULL;
+    }
+#endif
+    alloc->kind = DEFER_ALLOC_ALIGNED;
+    return alloc->ptr;
+}
+
+void defer_alloc_release(defer_alloc_t* alloc) {
+    if (alloc->kind == DEFER_ALLOC_ALIGNED) {
+#ifdef _WIN32
+        _aligned_free(alloc->ptr);
+#else
+        free(alloc->ptr);
+#endif
+    }
+#ifdef DEFER_POSIX
+    else if (alloc->kind != DEFER_ALLOC_NONE) {
+        munmap(alloc->ptr, alloc->size);
+    }
+#endif
+    alloc->ptr = NULL;
+    alloc->size = 0;
+    alloc->kind = DEFER_ALLOC_NONE;
+}
+
+// Exiting processes leave the memory to the kernel
+void cleanup_alloc(void* ptr) {
+    if (!defer_exiting()) {
+        defer_alloc_release((defer_alloc_t*)ptr);
+    }
+}
+
+#ifdef DEFER_POSIX
+
+static void defer_reader_advise(int fd, off_t offset, off_t len, int advice) {
+#ifdef POSIX_FADV_SEQUENTIAL
+    (void)posix_fadvise(fd, offset, len, advice);
+#else
+    (void)fd; (void)offset; (void)len; (void)advice;
+#endif
+}
+
+int defer_reader_open(defer_reader_t* reader, const char* path, size_t bufsize, int flags) {
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = -1;
+    reader->flags = flags;
+
+    if (bufsize == 0) {
+        bufsize = DEFER_READER_BUFSIZE;
+    }
+    // O_DIRECT needs every read to start and end on an aligned boundary
+    bufsize = (bufsize + DEFER_READER_ALIGN - 1) & ~(size_t)(DEFER_READER_ALIGN - 1);
+    reader->bufsize = bufsize;
+
+#ifdef O_DIRECT
+    if (flags & DEFER_READER_DIRECT) {
+        reader->fd = open(path, O_RDONLY | O_DIRECT);
+    }
+#endif
+    if (reader->fd < 0) {
+        // Filesystems such as tmpfs reject O_DIRECT
+        reader->flags &= ~DEFER_READER_DIRECT;
+        reader->fd = open(path, O_RDONLY);
+        if (reader->fd < 0) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        void* buf = NULL;
+        if (posix_memalign(&buf, DEFER_READER_ALIGN, bufsize) != 0) {
+            defer_reader_close(reader);
+            errno = ENOMEM;
+            return -1;
+        }
+        reader->buf[i] = (unsigned char*)buf;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    defer_reader_advise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return 0;
+}
+
+ssize_t defer_reader_next(defer_reader_t* reader, const void** data) {
+    if (reader->eof) {
+        return 0;
+    }
+
+    reader->cur ^= 1;
+    unsigned char* buf = reader->buf[reader->cur];
+    size_t filled = 0;
+    while (filled < reader->bufsize) {
+        // O_DIRECT continues a short read from the aligned boundary below it,
+        // reading the partial block again
+        size_t start = filled;
+        if (reader->flags & DEFER_READER_DIRECT) {
+            start &= ~(size_t)(DEFER_READER_ALIGN - 1);
+        }
+        ssize_t n = pread(reader->fd, buf + start, reader->bufsize - start,
+                          reader->offset + (off_t)start);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (start + (size_t)n <= filled) {
+            // Nothing past what we already have: end of file
+            reader->eof = 1;
+            break;
+        }
+        filled = start + (size_t)n;
+    }
+    reader->offset += (off_t)filled;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (!(reader->flags & DEFER_READER_DIRECT)) {
+        // Start readahead of the next chunk while the caller processes this one
+        if (!reader->eof) {
+            defer_reader_advise(reader->fd, reader->offset, (off_t)reader->bufsize, POSIX_FADV_WILLNEED);
+        }
+        // Drop pages behind the cursor. Pages that were still busy the first time
+        // survive the advice, so each call also covers the previous chunk again.
+        if (!(reader->flags & DEFER_READER_KEEP_CACHE)) {
+            defer_reader_advise(reader->fd, reader->dropped, reader->offset - reader->dropped, POSIX_FADV_DONTNEED);
+            reader->dropped = reader->offset - (off_t)filled;
+        }
+    }
+#endif
+
+    *data = buf;
+    return (ssize_t)filled;
+}
+
+int defer_reader_close(defer_reader_t* reader) {
+    int result = 0;
+    if (reader->fd >= 0) {
+#ifdef POSIX_FADV_DONTNEED
+        // Pages read ahead past the cursor are of no further use either
+        if (!(reader->flags & (DEFER_READER_DIRECT | DEFER_READER_KEEP_CACHE))) {
+            defer_reader_advise(reader->fd, reader->dropped, 0, POSIX_FADV_DONTNEED);
+        }
+#endif
+        result = close(reader->fd);
+        reader->fd = -1;
+    }
+    free(reader->buf[0]);
+    free(reader->buf[1]);
+    reader->buf[0] = reader->buf[1] = NULL;
+    return result;
+}
+
+void cleanup_reader(void* ptr) {
+    defer_reader_close((defer_reader_t*)ptr);
+}
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// Number of iovecs gathered into one writev() call
+#define DEFER_WRITER_BATCH 64
+
+// Write every byte described by `iov`. The array is consumed in place.
+static int defer_writev_all(int fd, struct iovec* iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = writev(fd, iov, iovcnt < IOV_MAX ? iovcnt : IOV_MAX);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+static int defer_writer_fail(defer_writer_t* writer) {
+    if (!writer->error) {
+        writer->error = errno ? errno : EIO;
+    }
+    errno = writer->error;
+    return -1;
+}
+
+int defer_writer_open(defer_writer_t* writer, int fd, size_t bufsize, int flags) {
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = fd;
+    writer->flags = flags;
+    writer->bufsize = bufsize ? bufsize : DEFER_WRITER_BUFSIZE;
+    writer->buf = (unsigned char*)malloc(writer->bufsize);
+    if (!writer->buf) {
+        writer->fd = -1;
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+int defer_writer_flush(defer_writer_t* writer) {
+    if (writer->error) {
+        return defer_writer_fail(writer);
+    }
+    if (writer->len > 0) {
+        struct iovec iov = { writer->buf, writer->len };
+        if (defer_writev_all(writer->fd, &iov, 1) != 0) {
+            return defer_writer_fail(writer);
+        }
+        writer->len = 0;
+    }
+    return 0;
+}
+
+int defer_writer_write(defer_writer_t* writer, const void* data, size_t len) {
+    struct iovec iov = { (void*)data, len };
+    return defer_writer_writev(writer, &iov, 1);
+}
+
+int defer_writer_writev(defer_writer_t* writer, const struct iovec* iov, int iovcnt) {
+    if (writer->error) {
+        return defer_writer_fail(writer);
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        total += iov[i].iov_len;
+    }
+
+    // Small appends are copied and batched
+    if (total <= writer->bufsize - writer->len) {
+        for (int i = 0; i < iovcnt; i++) {
+            memcpy(writer->buf + writer->len, iov[i].iov_base, iov[i].iov_len);
+            writer->len += iov[i].iov_len;
+        }
+        return 0;
+    }
+
+    // Large appends go straight from the caller's memory, gathered behind
+    // whatever is already buffered so both leave in the same writev()
+    struct iovec batch[DEFER_WRITER_BATCH];
+    int count = 0;
+    if (writer->len > 0) {
+        batch[count].iov_base = writer->buf;
+        batch[count].iov_len = writer->len;
+        count++;
+    }
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0) {
+            continue;
+        }
+        batch[count++] = iov[i];
+        if (count == DEFER_WRITER_BATCH) {
+            if (defer_writev_all(writer->fd, batch, count) != 0) {
+                return defer_writer_fail(writer);
+            }
+            count = 0;
+        }
+    }
+    if (count > 0 && defer_writev_all(writer->fd, batch, count) != 0) {
+        return defer_writer_fail(writer);
+    }
+    writer->len = 0;
+    return 0;
+}
+
+int defer_writer_close(defer_writer_t* writer) {
+    if (!writer->buf) {
+        return writer->error ? defer_writer_fail(writer) : 0;
+    }
+
+    int result = defer_writer_flush(writer);
+    free(writer->buf);
+    writer->buf = NULL;
+
+    if ((writer->flags & DEFER_WRITER_CLOSE) && writer->fd >= 0) {
+        if (close(writer->fd) != 0 && result == 0) {
+            result = defer_writer_fail(writer);
+        }
+        writer->fd = -1;
+    }
+    return result;
+}
+
+void cleanup_writer(void* ptr) {
+    defer_writer_t* writer = (defer_writer_t*)ptr;
+    int result = defer_writer_close(writer);
+    if (writer->status) {
+        *writer->status = result == 0 ? 0 : writer->error;
+    }
+}
+
+// One group commit. Lives on the leader's stack until every follower has
+// collected its result.
+typedef struct {
+    int fds[DEFER_FSYNC_MAX_BATCH];
+    int results[DEFER_FSYNC_MAX_BATCH];
+    int count;
+    int done;
+    int waiters;
+} defer_fsync_batch_t;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    defer_fsync_batch_t* open;  // Batch accepting new members
+    int flushing;               // A leader is inside fsync()
+    long window_us;
+    int datasync;
+} defer_fsync_group = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0, 0, 0 };
+
+void defer_fsync_config(long window_us, int datasync) {
+    pthread_mutex_lock(&defer_fsync_group.lock);
+    defer_fsync_group.window_us = window_us > 0 ? window_us : 0;
+    defer_fsync_group.datasync = datasync;
+    pthread_mutex_unlock(&defer_fsync_group.lock);
+}
+
+static int defer_fsync_result(int result) {
+    if (result != 0) {
+        errno = result;
+        return -1;
+    }
+    return 0;
+}
+
+int defer_fsync_commit(int fd) {
+    pthread_mutex_lock(&defer_fsync_group.lock);
+
+    // Follower: join the open batch and wait for its leader
+    defer_fsync_batch_t* open = defer_fsync_group.open;
+    if (open && open->count < DEFER_FSYNC_MAX_BATCH) {
+        int slot = open->count++;
+        open->fds[slot] = fd;
+        open->waiters++;
+        while (!open->done) {
+            pthread_cond_wait(&defer_fsync_group.cond, &defer_fsync_group.lock);
+        }
+        int result = open->results[slot];
+        if (--open->waiters == 0) {
+            pthread_cond_broadcast(&defer_fsync_group.cond);
+        }
+        pthread_mutex_unlock(&defer_fsync_group.lock);
+        return defer_fsync_result(result);
+    }
+
+    // Leader: open a new batch and give others time to join
+    defer_fsync_batch_t batch;
+    batch.fds[0] = fd;
+    batch.count = 1;
+    batch.done = 0;
+    batch.waiters = 0;
+    defer_fsync_group.open = &batch;
+    long window_us = defer_fsync_group.window_us;
+    int datasync = defer_fsync_group.datasync;
+    pthread_mutex_unlock(&defer_fsync_group.lock);
+
+    if (window_us > 0) {
+        struct timespec ts = { window_us / 1000000, (window_us % 1000000) * 1000 };
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+        }
+    }
+
+    // Keep collecting while the previous batch is still being flushed
+    pthread_mutex_lock(&defer_fsync_group.lock);
+    while (defer_fsync_group.flushing) {
+        pthread_cond_wait(&defer_fsync_group.cond, &defer_fsync_group.lock);
+    }
+    if (defer_fsync_group.open == &batch) {
+        defer_fsync_group.open = NULL;
+    }
+    defer_fsync_group.flushing = 1;
+    pthread_mutex_unlock(&defer_fsync_group.lock);
+
+    for (int i = 0; i < batch.count; i++) {
+        int j = 0;
+        while (j < i && batch.fds[j] != batch.fds[i]) {
+            j++;
+        }
+        if (j < i) {
+            batch.results[i] = batch.results[j];
+            continue;
+        }
+#if defined(_POSIX_SYNCHRONIZED_IO) && _POSIX_SYNCHRONIZED_IO > 0
+        int rc = datasync ? fdatasync(batch.fds[i]) : fsync(batch.fds[i]);
+#else
+        (void)datasync;
+        int rc = fsync(batch.fds[i]);
+#endif
+        batch.results[i] = rc == 0 ? 0 : errno;
+    }
+
+    pthread_mutex_lock(&defer_fsync_group.lock);
+    defer_fsync_group.flushing = 0;
+    batch.done = 1;
+    pthread_cond_broadcast(&defer_fsync_group.cond);
+    while (batch.waiters > 0) {
+        pthread_cond_wait(&defer_fsync_group.cond, &defer_fsync_group.lock);
+    }
+    pthread_mutex_unlock(&defer_fsync_group.lock);
+    return defer_fsync_result(batch.results[0]);
+}
+
+void cleanup_fsync(void* ptr) {
+    defer_fsync_t* state = (defer_fsync_t*)ptr;
+    if (state->fd < 0) {
+        return;
+    }
+    int result = defer_fsync_commit(state->fd) == 0 ? 0 : errno;
+    if (state->status) {
+        *state->status = result;
+    }
+}
+
+void cleanup_close(void* ptr) {
+    int* fd = (int*)ptr;
+    if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+#if defined(__linux__) && defined(SPLICE_F_MOVE)
+#define DEFER_HAVE_SPLICE 1
+
+// A pipe pair leased from the pool. `dirty` is set when data may still be
+// sitting in the pipe, in which case it is closed instead of pooled.
+typedef struct {
+    int fds[2];
+    int dirty;
+} defer_pipe_t;
+
+static struct {
+    pthread_mutex_t lock;
+    int count;
+    int fds[DEFER_PIPE_POOL][2];
+} defer_pipe_pool = { PTHREAD_MUTEX_INITIALIZER, 0, {{0}} };
+
+static int defer_pipe_acquire(defer_pipe_t* pipe_pair) {
+    pipe_pair->dirty = 0;
+    pthread_mutex_lock(&defer_pipe_pool.lock);
+    if (defer_pipe_pool.count > 0) {
+        defer_pipe_pool.count--;
+        pipe_pair->fds[0] = defer_pipe_pool.fds[defer_pipe_pool.count][0];
+        pipe_pair->fds[1] = defer_pipe_pool.fds[defer_pipe_pool.count][1];
+        pthread_mutex_unlock(&defer_pipe_pool.lock);
+        return 0;
+    }
+    pthread_mutex_unlock(&defer_pipe_pool.lock);
+
+    if (pipe2(pipe_pair->fds, O_CLOEXEC) != 0) {
+        pipe_pair->fds[0] = pipe_pair->fds[1] = -1;
+        return -1;
+    }
+#ifdef F_SETPIPE_SZ
+    (void)fcntl(pipe_pair->fds[1], F_SETPIPE_SZ, 1024 * 1024);
+#endif
+    return 0;
+}
+
+static void defer_pipe_release(void* ptr) {
+    defer_pipe_t* pipe_pair = (defer_pipe_t*)ptr;
+    if (pipe_pair->fds[0] < 0) {
+        return;
+    }
+    if (!pipe_pair->dirty) {
+        pthread_mutex_lock(&defer_pipe_pool.lock);
+        if (defer_pipe_pool.count < DEFER_PIPE_POOL) {
+            defer_pipe_pool.fds[defer_pipe_pool.count][0] = pipe_pair->fds[0];
+            defer_pipe_pool.fds[defer_pipe_pool.count][1] = pipe_pair->fds[1];
+            defer_pipe_pool.count++;
+            pthread_mutex_unlock(&defer_pipe_pool.lock);
+            return;
+        }
+        pthread_mutex_unlock(&defer_pipe_pool.lock);
+    }
+    close(pipe_pair->fds[0]);
+    close(pipe_pair->fds[1]);
+}
+
+static ssize_t defer_splice_file(int out_fd, int in_fd, off_t offset, size_t len) {
+    defer_pipe_t pipe_pair;
+    if (defer_pipe_acquire(&pipe_pair) != 0) {
+        return -1;
+    }
+    defer(defer_pipe_release, &pipe_pair);
+
+    size_t sent = 0;
+    loff_t in_off = offset;
+    while (sent < len) {
+        ssize_t in = splice(in_fd, &in_off, pipe_pair.fds[1], NULL, len - sent, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (in < 0 && errno == EINTR) {
+            continue;
+        }
+        if (in <= 0) {
+            return in < 0 && sent == 0 ? -1 : (ssize_t)sent;
+        }
+        pipe_pair.dirty = 1;
+        while (in > 0) {
+            ssize_t out = splice(pipe_pair.fds[0], NULL, out_fd, NULL, (size_t)in, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (out < 0 && errno == EINTR) {
+                continue;
+            }
+            if (out <= 0) {
+                return sent == 0 ? -1 : (ssize_t)sent;
+            }
+            in -= out;
+            sent += (size_t)out;
+        }
+        pipe_pair.dirty = 0;
+    }
+    return (ssize_t)sent;
+}
+#endif
+
+static ssize_t defer_copy_file(int out_fd, int in_fd, off_t offset, size_t len) {
+    size_t bufsize = len < 65536 ? len : 65536;
+    char* buf = (char*)malloc(bufsize ? bufsize : 1);
+    if (!buf) {
+        errno = ENOMEM;
+        return -1;
+    }
+    defer(free, buf);
+
+    size_t sent = 0;
+    while (sent < len) {
+        size_t want = len - sent < bufsize ? len - sent : bufsize;
+        ssize_t n = pread(in_fd, buf, want, offset + (off_t)sent);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        for (ssize_t done = 0; done < n;) {
+            ssize_t w = write(out_fd, buf + done, (size_t)(n - done));
+            if (w < 0 && errno == EINTR) {
+                continue;
+            }
+            if (w <= 0) {
+                return sent == 0 ? -1 : (ssize_t)sent;
+            }
+            done += w;
+            sent += (size_t)w;
+        }
+    }
+    return (ssize_t)sent;
+}
+
+ssize_t defer_sendfile(int out_fd, const char* in_path, off_t offset, size_t len) {
+    int in_fd = open(in_path, O_RDONLY);
+    if (in_fd < 0) {
+        return -1;
+    }
+    defer_close(&in_fd);
+
+    if (len == 0) {
+        struct stat st;
+        if (fstat(in_fd, &st) != 0) {
+            return -1;
+        }
+        if (st.st_size <= offset) {
+            return 0;
+        }
+        len = (size_t)(st.st_size - offset);
+    }
+
+#if defined(__linux__)
+    size_t sent = 0;
+    off_t in_off = offset;
+    while (sent < len) {
+        ssize_t n = sendfile(out_fd, in_fd, &in_off, len - sent);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n < 0 && sent == 0 && (errno == EINVAL || errno == ENOSYS)) {
+                break;  // Not supported for this pair of descriptors
+            }
+            return n < 0 && sent == 0 ? -1 : (ssize_t)sent;
+        }
+        sent += (size_t)n;
+    }
+    if (sent == len) {
+        return (ssize_t)sent;
+    }
+#endif
+
+#ifdef DEFER_HAVE_SPLICE
+    ssize_t spliced = defer_splice_file(out_fd, in_fd, offset, len);
+    if (spliced >= 0 || (errno != EINVAL && errno != ENOSYS)) {
+        return spliced;
+    }
+#endif
+    return defer_copy_file(out_fd, in_fd, offset, len);
+}
+
+typedef struct defer_task {
+    struct defer_task* next;  // Injection queue link
+    defer_task_fn fn;
+    void* arg;
+    defer_nursery_t* nursery;
+} defer_task_t;
+
+// Chase-Lev work-stealing deque with a fixed-size ring. The owner pushes and
+// takes at the bottom, thieves steal from the top.
+typedef struct {
+    long top;
+    char pad[64 - sizeof(long)];
+    long bottom;
+    defer_task_t* tasks[DEFER_DEQUE_SIZE];
+} defer_deque_t;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int started;
+    int stopping;
+    int count;
+    pthread_t* threads;
+    defer_deque_t* deques;
+    defer_task_t* inject_head;  // Tasks spawned from outside the pool
+    defer_task_t* inject_tail;
+    long epoch;                 // Bumped whenever new work or a completion appears
+    int sleepers;
+} defer_workers = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 0, NULL, NULL, NULL, NULL, 0, 0 };
+
+static __thread int defer_worker_index = -1;
+static __thread defer_nursery_t* defer_current_nursery = NULL;
+
+static int defer_deque_push(defer_deque_t* deque, defer_task_t* task) {
+    long b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    long t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    if (b - t >= DEFER_DEQUE_SIZE) {
+        return -1;
+    }
+    __atomic_store_n(&deque->tasks[b & (DEFER_DEQUE_SIZE - 1)], task, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static defer_task_t* defer_deque_take(defer_deque_t* deque) {
+    long b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long t = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+    if (t > b) {
+        __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    defer_task_t* task = __atomic_load_n(&deque->tasks[b & (DEFER_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (t == b) {
+        // Last task: race against thieves for it
+        if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            task = NULL;
+        }
+        __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+static defer_task_t* defer_deque_steal(defer_deque_t* deque) {
+    long t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long b = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) {
+        return NULL;
+    }
+    defer_task_t* task = __atomic_load_n(&deque->tasks[t & (DEFER_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    return task;
+}
+
+static void defer_workers_notify(void) {
+    __atomic_fetch_add(&defer_workers.epoch, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&defer_workers.sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&defer_workers.lock);
+        pthread_cond_broadcast(&defer_workers.wake);
+        pthread_mutex_unlock(&defer_workers.lock);
+    }
+}
+
+// Sleep until notified, unless something happened since `epoch` was read
+static void defer_workers_wait(long epoch) {
+    pthread_mutex_lock(&defer_workers.lock);
+    __atomic_fetch_add(&defer_workers.sleepers, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&defer_workers.epoch, __ATOMIC_SEQ_CST) == epoch && !defer_workers.stopping) {
+        pthread_cond_wait(&defer_workers.wake, &defer_workers.lock);
+    }
+    __atomic_fetch_sub(&defer_workers.sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&defer_workers.lock);
+}
+
+static defer_task_t* defer_workers_find(void) {
+    int self = defer_worker_index;
+    defer_task_t* task = NULL;
+    if (self >= 0) {
+        task = defer_deque_take(&defer_workers.deques[self]);
+    }
+    for (int i = 1; !task && i <= defer_workers.count; i++) {
+        int victim = (self + i + defer_workers.count) % defer_workers.count;
+        if (victim != self) {
+            task = defer_deque_steal(&defer_workers.deques[victim]);
+        }
+    }
+    if (!task && __atomic_load_n(&defer_workers.inject_head, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&defer_workers.lock);
+        task = defer_workers.inject_head;
+        if (task) {
+            defer_workers.inject_head = task->next;
+            if (!defer_workers.inject_head) {
+                defer_workers.inject_tail = NULL;
+            }
+        }
+        pthread_mutex_unlock(&defer_workers.lock);
+    }
+    return task;
+}
+
+static int defer_nursery_is_cancelled(defer_nursery_t* nursery) {
+    for (; nursery; nursery = nursery->parent) {
+        if (__atomic_load_n(&nursery->cancelled, __ATOMIC_ACQUIRE)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void defer_task_run(defer_task_t* task) {
+    defer_nursery_t* nursery = task->nursery;
+    if (defer_nursery_is_cancelled(nursery)) {
+        __atomic_fetch_add(&nursery->skipped, 1, __ATOMIC_RELAXED);
+    } else {
+        defer_nursery_t* saved = defer_current_nursery;
+        defer_current_nursery = nursery;
+        int error = task->fn(task->arg);
+        defer_current_nursery = saved;
+
+        if (error != 0) {
+            __atomic_fetch_add(&nursery->failed, 1, __ATOMIC_RELAXED);
+            nursery_cancel(nursery);
+            defer_task_error_t* record = (defer_task_error_t*)malloc(sizeof(defer_task_error_t));
+            if (record) {
+                record->fn = task->fn;
+                record->arg = task->arg;
+                record->error = error;
+                pthread_mutex_lock(&nursery->lock);
+                record->next = nursery->errors;
+                nursery->errors = record;
+                pthread_mutex_unlock(&nursery->lock);
+            }
+        }
+    }
+    free(task);
+    if (__atomic_sub_fetch(&nursery->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        defer_workers_notify();  // Wake a joiner
+    }
+}
+
+static void* defer_worker_main(void* arg) {
+    defer_worker_index = (int)(intptr_t)arg;
+    for (;;) {
+        long epoch = __atomic_load_n(&defer_workers.epoch, __ATOMIC_SEQ_CST);
+        defer_task_t* task = defer_workers_find();
+        if (task) {
+            defer_task_run(task);
+            continue;
+        }
+        if (__atomic_load_n(&defer_workers.stopping, __ATOMIC_ACQUIRE)) {
+            return NULL;
+        }
+        defer_workers_wait(epoch);
+    }
+}
+
+static int defer_workers_start(void) {
+    if (__atomic_load_n(&defer_workers.started, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    pthread_mutex_lock(&defer_workers.lock);
+    if (!defer_workers.started) {
+        int count = DEFER_WORKERS;
+        if (count <= 0) {
+            long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            count = cpus > 0 ? (int)cpus : 1;
+        }
+        void* deques = NULL;
+        defer_workers.threads = (pthread_t*)calloc((size_t)count, sizeof(pthread_t));
+        if (posix_memalign(&deques, 64, (size_t)count * sizeof(defer_deque_t)) == 0 && defer_workers.threads) {
+            memset(deques, 0, (size_t)count * sizeof(defer_deque_t));
+            defer_workers.deques = (defer_deque_t*)deques;
+            defer_workers.stopping = 0;
+            defer_workers.count = 0;
+            for (int i = 0; i < count; i++) {
+                if (pthread_create(&defer_workers.threads[i], NULL, defer_worker_main, (void*)(intptr_t)i) != 0) {
+                    break;
+                }
+                defer_workers.count++;
+            }
+        } else {
+            free(deques);
+        }
+        __atomic_store_n(&defer_workers.started, defer_workers.count > 0, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&defer_workers.lock);
+    return defer_workers.started ? 0 : -1;
+}
+
+void defer_workers_shutdown(void) {
+    pthread_mutex_lock(&defer_workers.lock);
+    if (!defer_workers.started) {
+        pthread_mutex_unlock(&defer_workers.lock);
+        return;
+    }
+    __atomic_store_n(&defer_workers.stopping, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&defer_workers.wake);
+    pthread_mutex_unlock(&defer_workers.lock);
+
+    for (int i = 0; i < defer_workers.count; i++) {
+        pthread_join(defer_workers.threads[i], NULL);
+    }
+
+    pthread_mutex_lock(&defer_workers.lock);
+    free(defer_workers.threads);
+    free(defer_workers.deques);
+    defer_workers.threads = NULL;
+    defer_workers.deques = NULL;
+    defer_workers.count = 0;
+    defer_workers.stopping = 0;
+    __atomic_store_n(&defer_workers.started, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&defer_workers.lock);
+}
+
+void defer_nursery_begin(defer_nursery_t* nursery) {
+    memset(nursery, 0, sizeof(*nursery));
+    pthread_mutex_init(&nursery->lock, NULL);
+    nursery->parent = defer_current_nursery;
+    defer_current_nursery = nursery;
+}
+
+int nursery_spawn_in(defer_nursery_t* nursery, defer_task_fn fn, void* arg) {
+    if (!nursery || !fn) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (defer_nursery_is_cancelled(nursery)) {
+        __atomic_fetch_add(&nursery->skipped, 1, __ATOMIC_RELAXED);
+        errno = ECANCELED;
+        return -1;
+    }
+
+    defer_task_t* task = (defer_task_t*)malloc(sizeof(defer_task_t));
+    if (!task) {
+        errno = ENOMEM;
+        return -1;
+    }
+    task->next = NULL;
+    task->fn = fn;
+    task->arg = arg;
+    task->nursery = nursery;
+    __atomic_fetch_add(&nursery->pending, 1, __ATOMIC_RELAXED);
+
+    if (defer_workers_start() != 0) {
+        defer_task_run(task);  // No pool: degrade to running inline
+        return 0;
+    }
+
+    int self = defer_worker_index;
+    if (self >= 0) {
+        if (defer_deque_push(&defer_workers.deques[self], task) != 0) {
+            defer_task_run(task);  // Deque full: run it ourselves
+            return 0;
+        }
+    } else {
+        pthread_mutex_lock(&defer_workers.lock);
+        if (defer_workers.inject_tail) {
+            defer_workers.inject_tail->next = task;
+        } else {
+            __atomic_store_n(&defer_workers.inject_head, task, __ATOMIC_RELEASE);
+        }
+        defer_workers.inject_tail = task;
+        pthread_mutex_unlock(&defer_workers.lock);
+    }
+    defer_workers_notify();
+    return 0;
+}
+
+int nursery_spawn(defer_task_fn fn, void* arg) {
+    return nursery_spawn_in(defer_current_nursery, fn, arg);
+}
+
+int nursery_join(defer_nursery_t* nursery) {
+    // Help with queued work instead of blocking while tasks are outstanding
+    while (__atomic_load_n(&nursery->pending, __ATOMIC_ACQUIRE) > 0) {
+        long epoch = __atomic_load_n(&defer_workers.epoch, __ATOMIC_SEQ_CST);
+        defer_task_t* task = defer_workers.count > 0 ? defer_workers_find() : NULL;
+        if (task) {
+            defer_task_run(task);
+        } else if (__atomic_load_n(&nursery->pending, __ATOMIC_ACQUIRE) > 0) {
+            defer_workers_wait(epoch);
+        }
+    }
+    return __atomic_load_n(&nursery->failed, __ATOMIC_ACQUIRE);
+}
+
+void nursery_cancel(defer_nursery_t* nursery) {
+    __atomic_store_n(&nursery->cancelled, 1, __ATOMIC_RELEASE);
+}
+
+int nursery_cancelled(void) {
+    return defer_nursery_is_cancelled(defer_current_nursery);
+}
+
+void cleanup_nursery(void* ptr) {
+    defer_nursery_t* nursery = (defer_nursery_t*)ptr;
+    nursery_join(nursery);
+    while (nursery->errors) {
+        defer_task_error_t* next = nursery->errors->next;
+        free(nursery->errors);
+        nursery->errors = next;
+    }
+    pthread_mutex_destroy(&nursery->lock);
+    if (defer_current_nursery == nursery) {
+        defer_current_nursery = nursery->parent;
+    }
+}
+
+#define DEFER_THREAD_EXIT_CHUNK 64
+
+typedef struct defer_exit_chunk {
+    struct defer_exit_chunk* prev;
+    size_t count;
+    defer_data_t entries[DEFER_THREAD_EXIT_CHUNK];
+} defer_exit_chunk_t;
+
+typedef struct {
+    size_t count;                   // Entries used in inline_entries
+    defer_exit_chunk_t* chunks;     // Overflow, newest chunk first
+    int armed;                      // Key value set for this thread
+    defer_data_t inline_entries[DEFER_THREAD_EXIT_INLINE];
+} defer_exit_list_t;
+
+static pthread_key_t defer_exit_key;
+static pthread_once_t defer_exit_once = PTHREAD_ONCE_INIT;
+static int defer_exit_key_ok = 0;
+static __thread defer_exit_list_t defer_exit_list;
+
+static void defer_exit_list_run(defer_exit_list_t* list) {
+    // Entries may register further entries while running; loop until empty
+    for (;;) {
+        defer_data_t entry;
+        defer_exit_chunk_t* chunk = list->chunks;
+        if (chunk) {
+            if (chunk->count == 0) {
+                list->chunks = chunk->prev;
+                free(chunk);
+                continue;
+            }
+            entry = chunk->entries[--chunk->count];
+        } else if (list->count > 0) {
+            entry = list->inline_entries[--list->count];
+        } else {
+            break;
+        }
+        entry.func(entry.arg);
+    }
+}
+
+static void defer_exit_destructor(void* value) {
+    defer_exit_list_t* list = (defer_exit_list_t*)value;
+    list->armed = 0;
+    defer_exit_list_run(list);
+}
+
+static void defer_exit_key_init(void) {
+    defer_exit_key_ok = pthread_key_create(&defer_exit_key, defer_exit_destructor) == 0;
+}
+
+int defer_thread_exit(void (*func)(void*), void* arg) {
+    if (!func) {
+        errno = EINVAL;
+        return -1;
+    }
+    defer_exit_list_t* list = &defer_exit_list;
+    if (!list->armed) {
+        pthread_once(&defer_exit_once, defer_exit_key_init);
+        if (!defer_exit_key_ok || pthread_setspecific(defer_exit_key, list) != 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+        list->armed = 1;
+    }
+
+    if (!list->chunks && list->count < DEFER_THREAD_EXIT_INLINE) {
+        list->inline_entries[list->count++] = (defer_data_t){ func, arg };
+        return 0;
+    }
+    defer_exit_chunk_t* chunk = list->chunks;
+    if (!chunk || chunk->count == DEFER_THREAD_EXIT_CHUNK) {
+        chunk = (defer_exit_chunk_t*)malloc(sizeof(defer_exit_chunk_t));
+        if (!chunk) {
+            errno = ENOMEM;
+            return -1;
+        }
+        chunk->prev = list->chunks;
+        chunk->count = 0;
+        list->chunks = chunk;
+    }
+    chunk->entries[chunk->count++] = (defer_data_t){ func, arg };
+    return 0;
+}
+
+void defer_thread_exit_run(void) {
+    defer_exit_list_t* list = &defer_exit_list;
+    defer_exit_list_run(list);
+    if (list->armed) {
+        pthread_setspecific(defer_exit_key, NULL);
+        list->armed = 0;
+    }
+}
+
+typedef struct {
+    defer_data_t entry;
+    int priority;
+} defer_atexit_entry_t;
+
+static struct {
+    pthread_mutex_t lock;
+    defer_atexit_entry_t* entries;  // Sorted by ascending priority, run from the end
+    size_t count;
+    size_t capacity;
+    int registered;
+} defer_atexit_list = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, 0 };
+
+static void defer_atexit_run(void) {
+    defer_set_exiting();
+    for (;;) {
+        pthread_mutex_lock(&defer_atexit_list.lock);
+        if (defer_atexit_list.count == 0) {
+            free(defer_atexit_list.entries);
+            defer_atexit_list.entries = NULL;
+            defer_atexit_list.capacity = 0;
+            pthread_mutex_unlock(&defer_atexit_list.lock);
+            return;
+        }
+        defer_data_t entry = defer_atexit_list.entries[--defer_atexit_list.count].entry;
+        pthread_mutex_unlock(&defer_atexit_list.lock);
+        entry.func(entry.arg);
+    }
+}
+
+int defer_atexit(void (*func)(void*), void* arg, int priority) {
+    if (!func) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&defer_atexit_list.lock);
+    if (!defer_atexit_list.registered) {
+        if (atexit(defer_atexit_run) != 0) {
+            pthread_mutex_unlock(&defer_atexit_list.lock);
+            errno = ENOMEM;
+            return -1;
+        }
+        defer_atexit_list.registered = 1;
+    }
+    if (defer_atexit_list.count == defer_atexit_list.capacity) {
+        size_t capacity = defer_atexit_list.capacity ? defer_atexit_list.capacity * 2 : 16;
+        defer_atexit_entry_t* entries = (defer_atexit_entry_t*)realloc(defer_atexit_list.entries, capacity * sizeof(defer_atexit_entry_t));
+        if (!entries) {
+            pthread_mutex_unlock(&defer_atexit_list.lock);
+            errno = ENOMEM;
+            return -1;
+        }
+        defer_atexit_list.entries = entries;
+        defer_atexit_list.capacity = capacity;
+    }
+
+    // Insert after every entry of lower or equal priority
+    size_t i = defer_atexit_list.count;
+    while (i > 0 && defer_atexit_list.entries[i - 1].priority > priority) {
+        defer_atexit_list.entries[i] = defer_atexit_list.entries[i - 1];
+        i--;
+    }
+    defer_atexit_list.entries[i].entry = (defer_data_t){ func, arg };
+    defer_atexit_list.entries[i].priority = priority;
+    defer_atexit_list.count++;
+    pthread_mutex_unlock(&defer_atexit_list.lock);
+    return 0;
+}
+
+typedef struct {
+    defer_ref_t* ref;
+    long pending;  // Releases not yet applied to ref->shared
+} defer_unref_slot_t;
+
+static __thread defer_unref_slot_t defer_unref_slots[DEFER_UNREF_SLOTS];
+static __thread int defer_unref_armed = 0;
+// Objects owned by this thread whose shared count went negative; the
+// queue's address doubles as the thread's owner token
+static __thread defer_ref_t* defer_ref_queue = NULL;
+
+static uintptr_t defer_ref_self(void) {
+    return (uintptr_t)&defer_ref_queue;
+}
+
+static void defer_ref_destroy(defer_ref_t* ref) {
+    defer_data_t data = { ref->dtor, ref->obj };
+    defer_cleanup(&data);
+}
+
+static int defer_ref_dead(long shared) {
+    return (shared >> 2) == 0 && (shared & (DEFER_REF_MERGED | DEFER_REF_QUEUED)) == DEFER_REF_MERGED;
+}
+
+// Owner side: fold the biased count into the shared count
+static void defer_ref_merge(defer_ref_t* ref) {
+    long biased = ref->biased;
+    ref->biased = 0;
+    __atomic_store_n(&ref->owner, 0, __ATOMIC_RELEASE);
+    long shared = __atomic_add_fetch(&ref->shared, (biased << 2) | DEFER_REF_MERGED, __ATOMIC_ACQ_REL);
+    if (defer_ref_dead(shared)) {
+        defer_ref_destroy(ref);
+    }
+}
+
+static void defer_ref_drain(void) {
+    if (!__atomic_load_n(&defer_ref_queue, __ATOMIC_RELAXED)) {
+        return;
+    }
+    defer_ref_t* ref = __atomic_exchange_n(&defer_ref_queue, NULL, __ATOMIC_ACQUIRE);
+    while (ref) {
+        defer_ref_t* next = ref->next;
+        long old = __atomic_fetch_and(&ref->shared, ~DEFER_REF_QUEUED, __ATOMIC_ACQ_REL);
+        if (old & DEFER_REF_MERGED) {
+            // Only the value that cleared QUEUED decides; a later release
+            // that reaches zero sees MERGED alone and destroys instead
+            if (defer_ref_dead(old & ~DEFER_REF_QUEUED)) {
+                defer_ref_destroy(ref);
+            }
+        } else {
+            defer_ref_merge(ref);
+        }
+        ref = next;
+    }
+}
+
+// Apply `count` releases to the shared count
+static void defer_ref_shared_sub(defer_ref_t* ref, long count) {
+    long shared = __atomic_sub_fetch(&ref->shared, count << 2, __ATOMIC_ACQ_REL);
+    if (defer_ref_dead(shared)) {
+        defer_ref_destroy(ref);
+    } else if (shared < 0 && !(shared & (DEFER_REF_MERGED | DEFER_REF_QUEUED))) {
+        // Released references the owner took: ask the owner to merge
+        long old = __atomic_fetch_or(&ref->shared, DEFER_REF_QUEUED, __ATOMIC_ACQ_REL);
+        if (old & DEFER_REF_QUEUED) {
+            return;  // Already queued by another release
+        }
+        defer_ref_t** queue = (defer_ref_t**)__atomic_load_n(&ref->owner, __ATOMIC_ACQUIRE);
+        if (!(old & DEFER_REF_MERGED) && queue) {
+            defer_ref_t* head = __atomic_load_n(queue, __ATOMIC_RELAXED);
+            do {
+                ref->next = head;
+            } while (!__atomic_compare_exchange_n(queue, &head, ref, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+        } else {
+            // The owner merged, or is merging, since the count went
+            // negative: nobody will drain this request, so take it back.
+            // Whoever clears QUEUED on a dead count destroys.
+            long now = __atomic_fetch_and(&ref->shared, ~DEFER_REF_QUEUED, __ATOMIC_ACQ_REL);
+            if (defer_ref_dead(now & ~DEFER_REF_QUEUED)) {
+                defer_ref_destroy(ref);
+            }
+        }
+    }
+}
+
+void defer_unref_flush(void) {
+    for (int i = 0; i < DEFER_UNREF_SLOTS; i++) {
+        defer_unref_slot_t* slot = &defer_unref_slots[i];
+        if (slot->ref) {
+            defer_ref_t* ref = slot->ref;
+            long pending = slot->pending;
+            slot->ref = NULL;
+            slot->pending = 0;
+            defer_ref_shared_sub(ref, pending);
+        }
+    }
+    defer_ref_drain();
+}
+
+static void defer_unref_thread_exit(void* arg) {
+    (void)arg;
+    defer_unref_armed = 0;
+    defer_unref_flush();
+}
+
+static int defer_unref_arm(void) {
+    if (!defer_unref_armed) {
+        if (defer_thread_exit(defer_unref_thread_exit, &defer_unref_armed) != 0) {
+            return -1;
+        }
+        defer_unref_armed = 1;
+    }
+    return 0;
+}
+
+void defer_ref_init(defer_ref_t* ref, void (*dtor)(void*), void* obj) {
+    ref->owner = defer_ref_self();
+    ref->biased = 1;
+    ref->shared = 0;
+    ref->next = NULL;
+    ref->dtor = dtor;
+    ref->obj = obj;
+    (void)defer_unref_arm();  // Drains the merge queue at thread exit
+}
+
+void defer_ref_acquire(defer_ref_t* ref) {
+    if (__atomic_load_n(&ref->owner, __ATOMIC_RELAXED) == defer_ref_self()) {
+        ref->biased++;
+    } else {
+        __atomic_fetch_add(&ref->shared, 4, __ATOMIC_RELAXED);
+    }
+}
+
+void defer_ref_release(defer_ref_t* ref) {
+    if (__atomic_load_n(&ref->owner, __ATOMIC_RELAXED) == defer_ref_self()) {
+        defer_ref_drain();
+        if (__atomic_load_n(&ref->owner, __ATOMIC_RELAXED) == 0) {
+            defer_ref_shared_sub(ref, 1);  // Merged by the drain
+        } else if (--ref->biased == 0) {
+            defer_ref_merge(ref);  // Last owner reference
+        }
+        return;
+    }
+
+    // Not the owner: buffer the release in a direct-mapped per-thread slot
+    if (defer_unref_arm() != 0) {
+        defer_ref_shared_sub(ref, 1);
+        return;
+    }
+    defer_unref_slot_t* slot = &defer_unref_slots[((uintptr_t)ref >> 4) & (DEFER_UNREF_SLOTS - 1)];
+    if (slot->ref != ref) {
+        if (slot->ref) {
+            defer_ref_t* evicted = slot->ref;
+            long pending = slot->pending;
+            slot->ref = NULL;
+            defer_ref_shared_sub(evicted, pending);
+        }
+        slot->ref = ref;
+        slot->pending = 0;
+    }
+    if (++slot->pending >= DEFER_UNREF_BATCH) {
+        slot->ref = NULL;
+        defer_ref_shared_sub(ref, slot->pending);
+        slot->pending = 0;
+    }
+}
+
+void cleanup_unref(void* ptr) {
+    defer_ref_release((defer_ref_t*)ptr);
+}
+
+static __thread defer_tick_t* defer_current_tick = NULL;
+static __thread char defer_tick_token;
+
+void defer_tick_init(defer_tick_t* tick) {
+    tick->owner = (uintptr_t)&defer_tick_token;
+    tick->head = 0;
+    tick->tail = 0;
+    tick->inbox_head = 0;
+    tick->inbox_tail = 0;
+    for (size_t i = 0; i < DEFER_TICK_SIZE; i++) {
+        tick->inbox[i].seq = i;
+    }
+    tick->prev = defer_current_tick;
+    defer_current_tick = tick;
+}
+
+// Vyukov bounded queue enqueue; only the loop thread dequeues
+static int defer_tick_post(defer_tick_t* tick, void (*func)(void*), void* arg) {
+    size_t pos = __atomic_load_n(&tick->inbox_tail, __ATOMIC_RELAXED);
+    defer_tick_cell_t* cell;
+    for (;;) {
+        cell = &tick->inbox[pos & (DEFER_TICK_SIZE - 1)];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&tick->inbox_tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            errno = EAGAIN;  // Inbox full
+            return -1;
+        } else {
+            pos = __atomic_load_n(&tick->inbox_tail, __ATOMIC_RELAXED);
+        }
+    }
+    cell->data.func = func;
+    cell->data.arg = arg;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int defer_to_tick_in(defer_tick_t* tick, void (*func)(void*), void* arg) {
+    if (!tick || !func) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (tick->owner != (uintptr_t)&defer_tick_token) {
+        return defer_tick_post(tick, func, arg);
+    }
+    if (tick->tail - tick->head == DEFER_TICK_SIZE) {
+        errno = EAGAIN;
+        return -1;
+    }
+    tick->ring[tick->tail++ & (DEFER_TICK_SIZE - 1)] = (defer_data_t){ func, arg };
+    return 0;
+}
+
+int defer_to_tick(void (*func)(void*), void* arg) {
+    return defer_to_tick_in(defer_current_tick, func, arg);
+}
+
+size_t defer_tick_run_in(defer_tick_t* tick) {
+    // Callbacks queued while draining wait for the next tick
+    size_t run = 0;
+    size_t end = tick->tail;
+    while (tick->head != end) {
+        defer_data_t data = tick->ring[tick->head++ & (DEFER_TICK_SIZE - 1)];
+        data.func(data.arg);
+        run++;
+    }
+
+    size_t inbox_end = __atomic_load_n(&tick->inbox_tail, __ATOMIC_ACQUIRE);
+    while (tick->inbox_head != inbox_end) {
+        size_t pos = tick->inbox_head;
+        defer_tick_cell_t* cell = &tick->inbox[pos & (DEFER_TICK_SIZE - 1)];
+        if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+            break;  // Producer claimed the cell but has not published it yet
+        }
+        defer_data_t data = cell->data;
+        tick->inbox_head = pos + 1;
+        __atomic_store_n(&cell->seq, pos + DEFER_TICK_SIZE, __ATOMIC_RELEASE);
+        data.func(data.arg);
+        run++;
+    }
+    return run;
+}
+
+size_t defer_tick_run(void) {
+    return defer_current_tick ? defer_tick_run_in(defer_current_tick) : 0;
+}
+
+// Drain what is still queued and unbind the loop from its thread
+void cleanup_tick(void* ptr) {
+    defer_tick_t* tick = (defer_tick_t*)ptr;
+    while (defer_tick_run_in(tick) > 0) {
+    }
+    if (defer_current_tick == tick) {
+        defer_current_tick = tick->prev;
+    }
+}
+
+static unsigned defer_pool_threads = 0;
+static __thread unsigned defer_pool_thread = 0;  // 1-based, 0 until first use
+
+static long defer_pool_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Each thread gets its own slot until there are more threads than slots
+static int defer_pool_slot_index(void) {
+    if (defer_pool_thread == 0) {
+        defer_pool_thread = __atomic_add_fetch(&defer_pool_threads, 1, __ATOMIC_RELAXED);
+    }
+    return (int)((defer_pool_thread - 1) % DEFER_POOL_AFFINITY);
+}
+
+static void** defer_pool_slot(defer_pool_t* pool) {
+    return &pool->affinity[defer_pool_slot_index()];
+}
+
+// Unlink up to `max` idle handles past the timeout, oldest first. Called with
+// the lock held; the caller destroys them after unlocking.
+static int defer_pool_collect_expired(defer_pool_t* pool, void** expired, int max) {
+    int count = 0;
+    if (pool->config.idle_timeout_ms <= 0) {
+        return 0;
+    }
+    long cutoff = defer_pool_now_ms() - pool->config.idle_timeout_ms;
+    while (count < max && pool->idle_count > 0 && pool->idle[pool->idle_head].idle_since_ms <= cutoff) {
+        expired[count++] = pool->idle[pool->idle_head].handle;
+        pool->idle_head = (pool->idle_head + 1) % pool->config.max_handles;
+        pool->idle_count--;
+        pool->total--;
+    }
+    return count;
+}
+
+int defer_pool_init(defer_pool_t* pool, const defer_pool_config_t* config) {
+    if (!config || !config->create || !config->destroy || config->max_handles <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(pool, 0, sizeof(*pool));
+    pool->config = *config;
+    pool->idle = (defer_pool_idle_t*)calloc((size_t)config->max_handles, sizeof(defer_pool_idle_t));
+    if (!pool->idle) {
+        errno = ENOMEM;
+        return -1;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->available, NULL);
+    return 0;
+}
+
+// All leases must have been returned
+void defer_pool_destroy(defer_pool_t* pool) {
+    for (int i = 0; i < DEFER_POOL_AFFINITY; i++) {
+        void* handle = __atomic_exchange_n(&pool->affinity[i], NULL, __ATOMIC_ACQUIRE);
+        if (handle) {
+            pool->config.destroy(handle, pool->config.ctx);
+        }
+    }
+    while (pool->idle_count > 0) {
+        pool->config.destroy(pool->idle[pool->idle_head].handle, pool->config.ctx);
+        pool->idle_head = (pool->idle_head + 1) % pool->config.max_handles;
+        pool->idle_count--;
+    }
+    free(pool->idle);
+    pool->idle = NULL;
+    pthread_cond_destroy(&pool->available);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+static void* defer_pool_take_affinity(defer_pool_t* pool) {
+    void** own = defer_pool_slot(pool);
+    void* handle = __atomic_exchange_n(own, NULL, __ATOMIC_ACQUIRE);
+    for (int i = 0; !handle && i < DEFER_POOL_AFFINITY; i++) {
+        if (__atomic_load_n(&pool->affinity[i], __ATOMIC_RELAXED)) {
+            handle = __atomic_exchange_n(&pool->affinity[i], NULL, __ATOMIC_ACQUIRE);
+        }
+    }
+    return handle;
+}
+
+// Get a handle without validation: affinity slot, idle stack, then a new one
+static void* defer_pool_get(defer_pool_t* pool, long deadline_ms) {
+    void* handle = __atomic_exchange_n(defer_pool_slot(pool), NULL, __ATOMIC_ACQUIRE);
+    if (handle) {
+        return handle;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        if (pool->idle_count > 0) {
+            pool->idle_count--;
+            handle = pool->idle[(pool->idle_head + pool->idle_count) % pool->config.max_handles].handle;
+            break;
+        }
+        if (pool->total < pool->config.max_handles) {
+            pool->total++;
+            pthread_mutex_unlock(&pool->lock);
+            handle = pool->config.create(pool->config.ctx);
+            if (!handle) {
+                pthread_mutex_lock(&pool->lock);
+                pool->total--;
+                pthread_cond_signal(&pool->available);
+                pthread_mutex_unlock(&pool->lock);
+                errno = EIO;
+            }
+            return handle;
+        }
+
+        // Exhausted: check other threads' slots, then wait for a release
+        __atomic_fetch_add(&pool->waiters, 1, __ATOMIC_SEQ_CST);
+        handle = defer_pool_take_affinity(pool);
+        if (handle) {
+            __atomic_fetch_sub(&pool->waiters, 1, __ATOMIC_SEQ_CST);
+            break;
+        }
+        int rc = 0;
+        if (deadline_ms < 0) {
+            pthread_cond_wait(&pool->available, &pool->lock);
+        } else {
+            long wait_ms = deadline_ms - defer_pool_now_ms();
+            if (wait_ms > 0) {
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME, &ts);
+                ts.tv_sec += wait_ms / 1000;
+                ts.tv_nsec += (wait_ms % 1000) * 1000000;
+                if (ts.tv_nsec >= 1000000000L) {
+                    ts.tv_sec++;
+                    ts.tv_nsec -= 1000000000L;
+                }
+                rc = pthread_cond_timedwait(&pool->available, &pool->lock, &ts);
+            } else {
+                rc = ETIMEDOUT;
+            }
+        }
+        __atomic_fetch_sub(&pool->waiters, 1, __ATOMIC_SEQ_CST);
+        if (rc == ETIMEDOUT && pool->idle_count == 0 && pool->total >= pool->config.max_handles) {
+            handle = defer_pool_take_affinity(pool);
+            if (!handle) {
+                errno = ETIMEDOUT;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return handle;
+}
+
+// timeout_ms < 0 waits forever, 0 fails at once when the pool is exhausted
+void* defer_pool_acquire(defer_pool_t* pool, long timeout_ms) {
+    long deadline_ms = timeout_ms < 0 ? -1 : defer_pool_now_ms() + timeout_ms;
+    for (;;) {
+        void* handle = defer_pool_get(pool, deadline_ms);
+        if (!handle || !pool->config.validate || pool->config.validate(handle, pool->config.ctx) == 0) {
+            return handle;
+        }
+        defer_pool_discard(pool, handle);  // Failed the health check
+    }
+}
+
+void defer_pool_release(defer_pool_t* pool, void* handle) {
+    if (__atomic_load_n(&pool->waiters, __ATOMIC_SEQ_CST) == 0) {
+        void* expected = NULL;
+        int index = defer_pool_slot_index();
+        if (__atomic_compare_exchange_n(&pool->affinity[index], &expected, handle, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&pool->affinity_since_ms[index], defer_pool_now_ms(), __ATOMIC_RELAXED);
+            if (__atomic_load_n(&pool->waiters, __ATOMIC_SEQ_CST) > 0) {
+                // A waiter arrived meanwhile and may have missed the slot
+                pthread_mutex_lock(&pool->lock);
+                pthread_cond_signal(&pool->available);
+                pthread_mutex_unlock(&pool->lock);
+            }
+            return;
+        }
+    }
+
+    void* expired[16];
+    pthread_mutex_lock(&pool->lock);
+    int top = (pool->idle_head + pool->idle_count) % pool->config.max_handles;
+    pool->idle[top].handle = handle;
+    pool->idle[top].idle_since_ms = defer_pool_now_ms();
+    pool->idle_count++;
+    pthread_cond_signal(&pool->available);
+    int count = defer_pool_collect_expired(pool, expired, 16);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < count; i++) {
+        pool->config.destroy(expired[i], pool->config.ctx);
+    }
+}
+
+// Destroy a handle from defer_pool_acquire() instead of returning it. Handles
+// leased with defer_checkout() are checked by `validate` on the next checkout.
+void defer_pool_discard(defer_pool_t* pool, void* handle) {
+    pool->config.destroy(handle, pool->config.ctx);
+    pthread_mutex_lock(&pool->lock);
+    pool->total--;
+    pthread_cond_signal(&pool->available);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Empties the affinity slots whose handle has been idle past the timeout. A
+// handle released just before the sweep may go with them; it was idle anyway.
+static int defer_pool_evict_affinity(defer_pool_t* pool) {
+    if (pool->config.idle_timeout_ms <= 0) {
+        return 0;
+    }
+    long cutoff = defer_pool_now_ms() - pool->config.idle_timeout_ms;
+    int count = 0;
+    for (int i = 0; i < DEFER_POOL_AFFINITY; i++) {
+        void* handle = __atomic_load_n(&pool->affinity[i], __ATOMIC_ACQUIRE);
+        if (!handle || __atomic_load_n(&pool->affinity_since_ms[i], __ATOMIC_RELAXED) > cutoff ||
+            !__atomic_compare_exchange_n(&pool->affinity[i], &handle, NULL, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        pool->config.destroy(handle, pool->config.ctx);
+        pthread_mutex_lock(&pool->lock);
+        pool->total--;
+        pthread_cond_signal(&pool->available);
+        pthread_mutex_unlock(&pool->lock);
+        count++;
+    }
+    return count;
+}
+
+int defer_pool_evict(defer_pool_t* pool) {
+    void* expired[16];
+    int total = defer_pool_evict_affinity(pool), count;
+    do {
+        pthread_mutex_lock(&pool->lock);
+        count = defer_pool_collect_expired(pool, expired, 16);
+        pthread_mutex_unlock(&pool->lock);
+        for (int i = 0; i < count; i++) {
+            pool->config.destroy(expired[i], pool->config.ctx);
+        }
+        total += count;
+    } while (count > 0);
+    return total;
+}
+
+void cleanup_lease(void* ptr) {
+    defer_lease_t* lease = (defer_lease_t*)ptr;
+    if (lease->handle) {
+        defer_pool_release(lease->pool, lease->handle);
+    }
+}
+
+static defer_handle_slot_t defer_handle_slots[DEFER_HANDLE_CAPACITY];
+static uint32_t defer_handle_used = 0;        // Slots ever handed out
+static uint64_t defer_handle_free = 0;        // Tag << 32 | (index + 1), 0 when empty
+
+static uint32_t defer_handle_pop(void) {
+    uint64_t head = __atomic_load_n(&defer_handle_free, __ATOMIC_ACQUIRE);
+    while ((uint32_t)head != 0) {
+        uint32_t index = (uint32_t)head - 1;
+        uint32_t next = __atomic_load_n(&defer_handle_slots[index].next_free, __ATOMIC_RELAXED);
+        // The tag in the high half defeats ABA when the slot is recycled meanwhile
+        uint64_t desired = ((head >> 32) + 1) << 32 | next;
+        if (__atomic_compare_exchange_n(&defer_handle_free, &head, desired, 1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            return index;
+        }
+    }
+    uint32_t index = __atomic_fetch_add(&defer_handle_used, 1, __ATOMIC_RELAXED);
+    if (index >= DEFER_HANDLE_CAPACITY) {
+        __atomic_fetch_sub(&defer_handle_used, 1, __ATOMIC_RELAXED);
+        return UINT32_MAX;
+    }
+    return index;
+}
+
+static void defer_handle_push(uint32_t index) {
+    uint64_t head = __atomic_load_n(&defer_handle_free, __ATOMIC_RELAXED);
+    uint64_t desired;
+    do {
+        __atomic_store_n(&defer_handle_slots[index].next_free, (uint32_t)head, __ATOMIC_RELAXED);
+        desired = ((head >> 32) + 1) << 32 | (index + 1);
+    } while (!__atomic_compare_exchange_n(&defer_handle_free, &head, desired, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// Returns 0 when the table is full
+defer_handle_t defer_handle_alloc(void* object, void (*dtor)(void*)) {
+    uint32_t index = defer_handle_pop();
+    if (index == UINT32_MAX) {
+        errno = ENOSPC;
+        return 0;
+    }
+    defer_handle_slot_t* slot = &defer_handle_slots[index];
+    __atomic_store_n(&slot->object, object, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->dtor, dtor, __ATOMIC_RELAXED);
+    uint32_t generation = __atomic_load_n(&slot->generation, __ATOMIC_RELAXED) + 1;
+    __atomic_store_n(&slot->generation, generation, __ATOMIC_RELEASE);
+    return (defer_handle_t)generation << 32 | index;
+}
+
+// NULL for stale or invalid handles
+void* defer_handle_get(defer_handle_t handle) {
+    uint32_t index = (uint32_t)handle;
+    uint32_t generation = (uint32_t)(handle >> 32);
+    if (index >= DEFER_HANDLE_CAPACITY || !(generation & 1)) {
+        return NULL;
+    }
+    defer_handle_slot_t* slot = &defer_handle_slots[index];
+    if (__atomic_load_n(&slot->generation, __ATOMIC_ACQUIRE) != generation) {
+        return NULL;
+    }
+    void* object = __atomic_load_n(&slot->object, __ATOMIC_RELAXED);
+    // Re-check: the slot may have been released and reused while reading
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&slot->generation, __ATOMIC_RELAXED) == generation ? object : NULL;
+}
+
+// Returns 0 if this call released the handle, -1 if it was already stale
+int defer_handle_release(defer_handle_t handle) {
+    uint32_t index = (uint32_t)handle;
+    uint32_t generation = (uint32_t)(handle >> 32);
+    if (index >= DEFER_HANDLE_CAPACITY || !(generation & 1)) {
+        return -1;
+    }
+    defer_handle_slot_t* slot = &defer_handle_slots[index];
+    // Only one releaser can move the slot from this generation to the next
+    if (!__atomic_compare_exchange_n(&slot->generation, &generation, generation + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        return -1;
+    }
+    defer_data_t data = { slot->dtor, slot->object };
+    defer_cleanup(&data);
+    defer_handle_push(index);
+    return 0;
+}
+
+// Visit live handles in slot order; returns the number visited
+size_t defer_handle_each(void (*func)(defer_handle_t handle, void* object, void* ctx), void* ctx) {
+    size_t visited = 0;
+    uint32_t used = __atomic_load_n(&defer_handle_used, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < used; i++) {
+        defer_handle_t handle = (defer_handle_t)__atomic_load_n(&defer_handle_slots[i].generation, __ATOMIC_ACQUIRE) << 32 | i;
+        void* object = defer_handle_get(handle);
+        if (object) {
+            func(handle, object, ctx);
+            visited++;
+        }
+    }
+    return visited;
+}
+
+void cleanup_handle(void* ptr) {
+    defer_handle_release(*(defer_handle_t*)ptr);
+}
+
+// Records the outcome of entering a scope and returns 0 or -1
+static int defer_scope_result(int* active, int error, int* status) {
+    *active = error == 0;
+    if (status) {
+        *status = error;
+    }
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+int defer_pin_cpu_enter(defer_affinity_t* scope, int cpu, int* status) {
+#if defined(__linux__) && defined(CPU_SETSIZE)
+    // The mask is kept as a plain array so the header does not depend on
+    // _GNU_SOURCE; the kernel takes masks of any size
+    cpu_set_t* saved = (cpu_set_t*)scope->mask;
+    if (cpu < 0 || cpu >= DEFER_MAX_CPUS) {
+        return defer_scope_result(&scope->active, EINVAL, status);
+    }
+    if (sched_getaffinity(0, sizeof(scope->mask), saved) != 0) {
+        return defer_scope_result(&scope->active, errno, status);
+    }
+    unsigned long pinned[sizeof(scope->mask) / sizeof(unsigned long)] = {0};
+    pinned[cpu / (8 * sizeof(unsigned long))] = 1UL << (cpu % (8 * sizeof(unsigned long)));
+    if (sched_setaffinity(0, sizeof(pinned), (cpu_set_t*)pinned) != 0) {
+        return defer_scope_result(&scope->active, errno, status);
+    }
+    return defer_scope_result(&scope->active, 0, status);
+#else
+    (void)cpu;
+    return defer_scope_result(&scope->active, ENOSYS, status);
+#endif
+}
+
+void cleanup_affinity(void* ptr) {
+    defer_affinity_t* scope = (defer_affinity_t*)ptr;
+#if defined(__linux__) && defined(CPU_SETSIZE)
+    if (scope->active) {
+        sched_setaffinity(0, sizeof(scope->mask), (cpu_set_t*)scope->mask);
+    }
+#endif
+    scope->active = 0;
+}
+
+int defer_sched_enter(defer_sched_t* scope, int policy, int priority, int* status) {
+    int error = pthread_getschedparam(pthread_self(), &scope->policy, &scope->param);
+    if (error) {
+        return defer_scope_result(&scope->active, error, status);
+    }
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    error = pthread_setschedparam(pthread_self(), policy, &param);
+    return defer_scope_result(&scope->active, error, status);
+}
+
+void cleanup_sched(void* ptr) {
+    defer_sched_t* scope = (defer_sched_t*)ptr;
+    if (scope->active) {
+        pthread_setschedparam(pthread_self(), scope->policy, &scope->param);
+        scope->active = 0;
+    }
+}
+
+static struct {
+    pthread_mutex_t lock;
+    int depth;
+    int flags;   // Flags of the outermost defer_mlockall section
+    int held;    // The process held locks before that section began
+    int future;  // MCL_FUTURE was in effect before it began
+} defer_memlock = { PTHREAD_MUTEX_INITIALIZER, 0, 0, 0, 0 };
+
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+    int refs;
+} defer_mlock_segment_t;
+
+// Sorted, disjoint segments of pages locked through defer_mlock. Each
+// segment boundary is an end of some held range, so 2 * DEFER_MLOCK_RANGES
+// segments always suffice. Updates are built in `next` and swapped in.
+static struct {
+    defer_mlock_segment_t lists[2][2 * DEFER_MLOCK_RANGES];
+    int count[2];
+    int current;
+    int next_count;
+    int ranges;
+    size_t locked;
+} defer_mlock_list;
+
+static void defer_mlock_emit(uintptr_t start, uintptr_t end, int refs) {
+    defer_mlock_segment_t* next = defer_mlock_list.lists[!defer_mlock_list.current];
+    int* count = &defer_mlock_list.next_count;
+    if (start >= end || refs == 0) {
+        return;
+    }
+    if (*count > 0 && next[*count - 1].end == start && next[*count - 1].refs == refs) {
+        next[*count - 1].end = end;
+        return;
+    }
+    next[*count].start = start;
+    next[*count].end = end;
+    next[*count].refs = refs;
+    (*count)++;
+}
+
+// Builds the segment list with `delta` added over [start, end) into the
+// spare list and returns the bytes that change between unlocked and locked.
+// Pages that drop to zero references are unlocked here, unless a
+// defer_mlockall section is keeping everything locked.
+static size_t defer_mlock_apply(uintptr_t start, uintptr_t end, int delta) {
+    const defer_mlock_segment_t* list = defer_mlock_list.lists[defer_mlock_list.current];
+    int count = defer_mlock_list.count[defer_mlock_list.current];
+    uintptr_t cursor = start;
+    size_t changed = 0;
+    defer_mlock_list.next_count = 0;
+    for (int i = 0; i < count; i++) {
+        const defer_mlock_segment_t* s = &list[i];
+        if (s->end <= start || s->start >= end) {
+            if (s->start >= end && cursor < end && delta > 0) {
+                defer_mlock_emit(cursor, end, 1);
+                changed += end - cursor;
+                cursor = end;
+            }
+            defer_mlock_emit(s->start, s->end, s->refs);
+            continue;
+        }
+        uintptr_t lo = s->start > start ? s->start : start;
+        uintptr_t hi = s->end < end ? s->end : end;
+        defer_mlock_emit(s->start, lo, s->refs);
+        if (cursor < lo && delta > 0) {
+            defer_mlock_emit(cursor, lo, 1);
+            changed += lo - cursor;
+        }
+        defer_mlock_emit(lo, hi, s->refs + delta);
+        if (s->refs + delta == 0) {
+            changed += hi - lo;
+            if (defer_memlock.depth == 0) {
+                munlock((void*)lo, hi - lo);
+            }
+        }
+        defer_mlock_emit(hi, s->end, s->refs);
+        cursor = hi;
+    }
+    if (cursor < end && delta > 0) {
+        defer_mlock_emit(cursor, end, 1);
+        changed += end - cursor;
+    }
+    return changed;
+}
+
+static void defer_mlock_commit(void) {
+    defer_mlock_list.current = !defer_mlock_list.current;
+    defer_mlock_list.count[defer_mlock_list.current] = defer_mlock_list.next_count;
+}
+
+// Unlocks the pages of [start, end) that no segment holds
+static void defer_mlock_unlock_gaps(uintptr_t start, uintptr_t end) {
+    const defer_mlock_segment_t* list = defer_mlock_list.lists[defer_mlock_list.current];
+    int count = defer_mlock_list.count[defer_mlock_list.current];
+    uintptr_t cursor = start;
+    for (int i = 0; i < count && cursor < end; i++) {
+        if (list[i].end <= cursor || list[i].start >= end) {
+            continue;
+        }
+        if (list[i].start > cursor) {
+            munlock((void*)cursor, list[i].start - cursor);
+        }
+        cursor = list[i].end;
+    }
+    if (cursor < end) {
+        munlock((void*)cursor, end - cursor);
+    }
+}
+
+// munlockall() also released the segments; lock them again
+static void defer_mlock_relock(void) {
+    const defer_mlock_segment_t* list = defer_mlock_list.lists[defer_mlock_list.current];
+    for (int i = 0; i < defer_mlock_list.count[defer_mlock_list.current]; i++) {
+        mlock((void*)list[i].start, list[i].end - list[i].start);
+    }
+}
+
+// Locked bytes of the process from VmLck, or -1 where /proc is unavailable
+static long defer_vmlck_bytes(void) {
+    FILE* status = fopen("/proc/self/status", "r");
+    if (!status) {
+        return -1;
+    }
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), status)) {
+        if (sscanf(line, "VmLck: %ld kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(status);
+    return kb < 0 ? -1 : kb * 1024;
+}
+
+// Records the locks held before the outermost section. MCL_FUTURE shows up
+// as a fresh mapping that is counted as locked.
+static void defer_mlockall_probe(void) {
+    defer_memlock.held = 0;
+    defer_memlock.future = 0;
+    long before = defer_vmlck_bytes();
+    if (before < 0) {
+        return;
+    }
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    void* probe = mmap(NULL, page, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (probe != MAP_FAILED) {
+        defer_memlock.future = defer_vmlck_bytes() > before;
+        munmap(probe, page);
+    }
+    defer_memlock.held = before > (long)defer_mlock_list.locked || defer_memlock.future;
+}
+
+int defer_mlockall_enter(defer_memlock_t* scope, int flags, int* status) {
+    pthread_mutex_lock(&defer_memlock.lock);
+    int error = 0;
+    if (defer_memlock.depth > 0) {
+        if (flags != defer_memlock.flags) {
+            error = EBUSY;
+        } else {
+            defer_memlock.depth++;
+        }
+    } else {
+        defer_mlockall_probe();
+        // mlockall() replaces MCL_FUTURE, so keep one that was already set
+        if (mlockall(flags | (defer_memlock.future ? MCL_FUTURE : 0)) != 0) {
+            error = errno;
+        } else {
+            defer_memlock.flags = flags;
+            defer_memlock.depth = 1;
+        }
+    }
+    pthread_mutex_unlock(&defer_memlock.lock);
+    return defer_scope_result(&scope->active, error, status);
+}
+
+void cleanup_mlockall(void* ptr) {
+    defer_memlock_t* scope = (defer_memlock_t*)ptr;
+    if (!scope->active) {
+        return;
+    }
+    scope->active = 0;
+    pthread_mutex_lock(&defer_memlock.lock);
+    if (--defer_memlock.depth == 0) {
+        if (!defer_memlock.held) {
+            munlockall();
+            defer_mlock_relock();
+        } else if (!defer_memlock.future && (defer_memlock.flags & MCL_FUTURE)) {
+            // Clears MCL_FUTURE again without unlocking anything
+            mlockall(MCL_CURRENT);
+        }
+    }
+    pthread_mutex_unlock(&defer_memlock.lock);
+}
+
+// Bytes the process would have locked after adding `added` new pages: every
+// lock it holds from VmLck, or just defer_mlock's own without /proc. Inside
+// a defer_mlockall section the new pages are already locked.
+static size_t defer_mlock_charge(size_t added) {
+    long held = defer_vmlck_bytes();
+    size_t locked = held > (long)defer_mlock_list.locked ? (size_t)held : defer_mlock_list.locked;
+    return locked + (defer_memlock.depth > 0 ? 0 : added);
+}
+
+int defer_mlock_enter(defer_mlock_t* scope, const void* ptr, size_t len, int* status) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    scope->start = (uintptr_t)ptr & ~(uintptr_t)(page - 1);
+    scope->end = ((uintptr_t)ptr + len + page - 1) & ~(uintptr_t)(page - 1);
+    if (len == 0) {
+        scope->active = 0;
+        if (status) {
+            *status = 0;
+        }
+        return 0;
+    }
+    if (scope->end < scope->start) {
+        return defer_scope_result(&scope->active, EINVAL, status);
+    }
+    pthread_mutex_lock(&defer_memlock.lock);
+    int error = 0;
+    size_t added = 0;
+    if (defer_mlock_list.ranges >= DEFER_MLOCK_RANGES) {
+        error = ENOSPC;
+    } else {
+        added = defer_mlock_apply(scope->start, scope->end, 1);
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY &&
+            defer_mlock_charge(added) > (size_t)limit.rlim_cur) {
+            error = ENOMEM;
+        } else if (mlock((void*)scope->start, scope->end - scope->start) != 0) {
+            error = errno;
+            // Pages other scopes hold stay locked; drop any the call locked
+            if (defer_memlock.depth == 0) {
+                defer_mlock_unlock_gaps(scope->start, scope->end);
+            }
+        }
+    }
+    if (error == 0) {
+        defer_mlock_commit();
+        defer_mlock_list.locked += added;
+        defer_mlock_list.ranges++;
+    }
+    pthread_mutex_unlock(&defer_memlock.lock);
+    return defer_scope_result(&scope->active, error, status);
+}
+
+void cleanup_mlock(void* ptr) {
+    defer_mlock_t* scope = (defer_mlock_t*)ptr;
+    if (!scope->active) {
+        return;
+    }
+    scope->active = 0;
+    pthread_mutex_lock(&defer_memlock.lock);
+    defer_mlock_list.locked -= defer_mlock_apply(scope->start, scope->end, -1);
+    defer_mlock_commit();
+    defer_mlock_list.ranges--;
+    pthread_mutex_unlock(&defer_memlock.lock);
+}
+
+size_t defer_mlock_locked(void) {
+    pthread_mutex_lock(&defer_memlock.lock);
+    size_t locked = defer_mlock_list.locked;
+    pthread_mutex_unlock(&defer_memlock.lock);
+    return locked;
+}
+
+#define DEFER_MEM_HEADER 16  // Keeps the malloc alignment of the payload
+
+static __thread long long defer_mem_live = 0;
+static __thread long long defer_mem_allocated = 0;
+static __thread long long defer_mem_freed = 0;
+static __thread defer_mem_scope_t* defer_mem_top = NULL;
+
+typedef struct {
+    const char* name;
+    unsigned long runs;
+    long long peak;       // Highest peak of any run
+    long long allocated;  // Totals over all runs
+    long long retained;   // Live bytes left behind at exit
+} defer_mem_phase_t;
+
+static struct {
+    pthread_mutex_t lock;
+    int count;
+    defer_mem_phase_t phases[DEFER_MEM_PHASES + 1];  // Last one collects overflow
+    void (*purge)(void* ctx);
+    void* purge_ctx;
+} defer_mem_registry = { PTHREAD_MUTEX_INITIALIZER, 0, {{0}}, NULL, NULL };
+
+static void defer_mem_charge(long long bytes) {
+    defer_mem_live += bytes;
+    if (bytes > 0) {
+        defer_mem_allocated += bytes;
+    } else {
+        defer_mem_freed -= bytes;
+    }
+    defer_mem_scope_t* top = defer_mem_top;
+    if (top && defer_mem_live - top->live_base > top->peak) {
+        top->peak = defer_mem_live - top->live_base;
+    }
+}
+
+void* defer_mem_malloc(size_t size) {
+    if (size > SIZE_MAX - DEFER_MEM_HEADER) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size_t* block = (size_t*)malloc(size + DEFER_MEM_HEADER);
+    if (!block) {
+        return NULL;
+    }
+    *block = size;
+    defer_mem_charge((long long)size);
+    return (char*)block + DEFER_MEM_HEADER;
+}
+
+void* defer_mem_realloc(void* ptr, size_t size) {
+    if (!ptr) {
+        return defer_mem_malloc(size);
+    }
+    if (size > SIZE_MAX - DEFER_MEM_HEADER) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size_t* block = (size_t*)((char*)ptr - DEFER_MEM_HEADER);
+    size_t old = *block;
+    block = (size_t*)realloc(block, size + DEFER_MEM_HEADER);
+    if (!block) {
+        return NULL;
+    }
+    *block = size;
+    defer_mem_charge(-(long long)old);
+    defer_mem_charge((long long)size);
+    return (char*)block + DEFER_MEM_HEADER;
+}
+
+void defer_mem_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    size_t* block = (size_t*)((char*)ptr - DEFER_MEM_HEADER);
+    defer_mem_charge(-(long long)*block);
+    if (!defer_exiting()) {
+        free(block);
+    }
+}
+
+void defer_mem_scope_enter(defer_mem_scope_t* scope, const char* name, size_t trim_bytes) {
+    scope->prev = defer_mem_top;
+    scope->name = name;
+    scope->trim_bytes = trim_bytes;
+    scope->live_base = defer_mem_live;
+    scope->allocated_base = defer_mem_allocated;
+    scope->freed_base = defer_mem_freed;
+    scope->peak = 0;
+    defer_mem_top = scope;
+}
+
+long long defer_mem_peak(void) {
+    return defer_mem_top ? defer_mem_top->peak : -1;
+}
+
+void defer_mem_set_purge(void (*purge)(void* ctx), void* ctx) {
+    pthread_mutex_lock(&defer_mem_registry.lock);
+    defer_mem_registry.purge = purge;
+    defer_mem_registry.purge_ctx = ctx;
+    pthread_mutex_unlock(&defer_mem_registry.lock);
+}
+
+static defer_mem_phase_t* defer_mem_phase(const char* name) {
+    for (int i = 0; i < defer_mem_registry.count; i++) {
+        if (strcmp(defer_mem_registry.phases[i].name, name) == 0) {
+            return &defer_mem_registry.phases[i];
+        }
+    }
+    if (defer_mem_registry.count < DEFER_MEM_PHASES) {
+        defer_mem_phase_t* phase = &defer_mem_registry.phases[defer_mem_registry.count++];
+        phase->name = name;
+        return phase;
+    }
+    defer_mem_registry.phases[DEFER_MEM_PHASES].name = "(other)";
+    return &defer_mem_registry.phases[DEFER_MEM_PHASES];
+}
+
+void cleanup_mem_scope(void* ptr) {
+    defer_mem_scope_t* scope = (defer_mem_scope_t*)ptr;
+    defer_mem_top = scope->prev;
+    if (scope->prev && scope->live_base + scope->peak - scope->prev->live_base > scope->prev->peak) {
+        scope->prev->peak = scope->live_base + scope->peak - scope->prev->live_base;
+    }
+
+    long long freed = defer_mem_freed - scope->freed_base;
+    pthread_mutex_lock(&defer_mem_registry.lock);
+    defer_mem_phase_t* phase = defer_mem_phase(scope->name ? scope->name : "(unnamed)");
+    phase->runs++;
+    phase->peak = scope->peak > phase->peak ? scope->peak : phase->peak;
+    phase->allocated += defer_mem_allocated - scope->allocated_base;
+    phase->retained += defer_mem_live - scope->live_base;
+    void (*purge)(void* ctx) = defer_mem_registry.purge;
+    void* purge_ctx = defer_mem_registry.purge_ctx;
+    pthread_mutex_unlock(&defer_mem_registry.lock);
+
+    if (scope->trim_bytes == 0 || freed < (long long)scope->trim_bytes) {
+        return;
+    }
+    if (purge) {
+        purge(purge_ctx);
+    } else {
+#if defined(__GLIBC__)
+        malloc_trim(0);
+#endif
+    }
+}
+
+static int defer_mem_compare_peak(const void* a, const void* b) {
+    long long x = ((const defer_mem_phase_t*)a)->peak, y = ((const defer_mem_phase_t*)b)->peak;
+    return x > y ? -1 : x < y;
+}
+
+void defer_mem_report(FILE* out) {
+    defer_mem_phase_t phases[DEFER_MEM_PHASES + 1];
+    pthread_mutex_lock(&defer_mem_registry.lock);
+    int count = defer_mem_registry.count;
+    memcpy(phases, defer_mem_registry.phases, (size_t)count * sizeof(defer_mem_phase_t));
+    if (defer_mem_registry.phases[DEFER_MEM_PHASES].runs) {
+        phases[count++] = defer_mem_registry.phases[DEFER_MEM_PHASES];
+    }
+    pthread_mutex_unlock(&defer_mem_registry.lock);
+
+    qsort(phases, (size_t)count, sizeof(defer_mem_phase_t), defer_mem_compare_peak);
+    fprintf(out, "%-24s %8s %14s %16s %14s\n", "phase", "runs", "peak bytes", "allocated bytes", "retained");
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "%-24s %8lu %14lld %16lld %14lld\n", phases[i].name, phases[i].runs,
+                phases[i].peak, phases[i].allocated, phases[i].retained);
+    }
+}
+
+int defer_shm_create(defer_shm_t* shm, const char* name, size_t size) {
+    memset(shm, 0, sizeof(*shm));
+    shm->fd = -1;
+    if (name && strlen(name) >= sizeof(shm->name)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    if (!name) {
+        shm->fd = memfd_create("defer_shm", MFD_CLOEXEC);
+    }
+#endif
+    if (!name && shm->fd < 0) {
+        // No memfd: create under a unique name and unlink it right away
+        char anon[64];
+        static unsigned long counter = 0;
+        for (int attempt = 0; attempt < 16 && shm->fd < 0; attempt++) {
+            snprintf(anon, sizeof(anon), "/defer_shm_%ld_%lu", (long)getpid(),
+                     __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED));
+            shm->fd = shm_open(anon, O_RDWR | O_CREAT | O_EXCL, 0600);
+        }
+        if (shm->fd >= 0) {
+            shm_unlink(anon);
+        }
+    } else if (name) {
+        shm->fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (shm->fd >= 0) {
+            strcpy(shm->name, name);
+            shm->owner = 1;
+        }
+    }
+    if (shm->fd < 0) {
+        return -1;
+    }
+    if (ftruncate(shm->fd, (off_t)size) != 0) {
+        defer_shm_close(shm);
+        return -1;
+    }
+    shm->addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+    if (shm->addr == MAP_FAILED) {
+        shm->addr = NULL;
+        defer_shm_close(shm);
+        return -1;
+    }
+    shm->size = size;
+    return 0;
+}
+
+int defer_shm_open(defer_shm_t* shm, const char* name) {
+    memset(shm, 0, sizeof(*shm));
+    shm->fd = shm_open(name, O_RDWR, 0);
+    if (shm->fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(shm->fd, &st) != 0) {
+        defer_shm_close(shm);
+        return -1;
+    }
+    shm->addr = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+    if (shm->addr == MAP_FAILED) {
+        shm->addr = NULL;
+        defer_shm_close(shm);
+        return -1;
+    }
+    shm->size = (size_t)st.st_size;
+    return 0;
+}
+
+// The name and descriptor go even while exiting; the mapping is left to the kernel
+int defer_shm_close(defer_shm_t* shm) {
+    int result = 0;
+    if (shm->addr && !defer_exiting() && munmap(shm->addr, shm->size) != 0) {
+        result = -1;
+    }
+    if (shm->fd >= 0 && close(shm->fd) != 0) {
+        result = -1;
+    }
+    if (shm->owner && shm_unlink(shm->name) != 0) {
+        result = -1;
+    }
+    shm->addr = NULL;
+    shm->fd = -1;
+    shm->owner = 0;
+    return result;
+}
+
+void cleanup_shm(void* ptr) {
+    defer_shm_close((defer_shm_t*)ptr);
+}
+
+#define DEFER_RING_MAGIC 0x676e697272666564ULL  // "deferring"
+#define DEFER_RING_WRAP (1ULL << 63)            // Header of the padding up to the end
+
+// Record size: an 8-byte length header plus the payload, 8-byte aligned
+static uint64_t defer_ring_record(uint64_t len) {
+    return (sizeof(uint64_t) + len + 7) & ~7ULL;
+}
+
+size_t defer_ring_bytes(size_t capacity) {
+    return sizeof(defer_ring_t) + capacity;
+}
+
+defer_ring_t* defer_ring_init(void* mem, size_t size) {
+    if (size < sizeof(defer_ring_t) + 64) {
+        errno = EINVAL;
+        return NULL;
+    }
+    uint64_t capacity = 64;
+    while (capacity * 2 <= size - sizeof(defer_ring_t)) {
+        capacity *= 2;
+    }
+    defer_ring_t* ring = (defer_ring_t*)mem;
+    memset(ring, 0, sizeof(*ring));
+    ring->capacity = capacity;
+    __atomic_store_n(&ring->magic, DEFER_RING_MAGIC, __ATOMIC_RELEASE);
+    return ring;
+}
+
+defer_ring_t* defer_ring_attach(void* mem) {
+    defer_ring_t* ring = (defer_ring_t*)mem;
+    if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != DEFER_RING_MAGIC) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return ring;
+}
+
+size_t defer_ring_max_message(const defer_ring_t* ring) {
+    // Half the ring, so a record always fits after wrapping
+    return (size_t)(ring->capacity / 2 - sizeof(uint64_t));
+}
+
+void* defer_ring_reserve(defer_ring_t* ring, size_t len) {
+    if (len > defer_ring_max_message(ring)) {
+        errno = EMSGSIZE;
+        return NULL;
+    }
+    uint64_t head = ring->head;
+    uint64_t index = head & (ring->capacity - 1);
+    uint64_t record = defer_ring_record(len);
+    uint64_t pad = record > ring->capacity - index ? ring->capacity - index : 0;
+    if (head + pad + record - ring->tail_cache > ring->capacity) {
+        ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (head + pad + record - ring->tail_cache > ring->capacity) {
+            errno = EAGAIN;
+            return NULL;
+        }
+    }
+    if (pad) {
+        *(uint64_t*)(ring->data + index) = DEFER_RING_WRAP;
+        index = 0;
+    }
+    *(uint64_t*)(ring->data + index) = len;
+    return ring->data + index + sizeof(uint64_t);
+}
+
+void defer_ring_commit(defer_ring_t* ring) {
+    uint64_t head = ring->head;
+    uint64_t index = head & (ring->capacity - 1);
+    if (*(uint64_t*)(ring->data + index) == DEFER_RING_WRAP) {
+        head += ring->capacity - index;
+        index = 0;
+    }
+    head += defer_ring_record(*(uint64_t*)(ring->data + index));
+    __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+}
+
+const void* defer_ring_peek(defer_ring_t* ring, size_t* len) {
+    uint64_t tail = ring->tail;
+    if (tail == ring->head_cache) {
+        ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (tail == ring->head_cache) {
+            errno = EAGAIN;
+            return NULL;
+        }
+    }
+    uint64_t index = tail & (ring->capacity - 1);
+    if (*(uint64_t*)(ring->data + index) == DEFER_RING_WRAP) {
+        // The producer publishes the padding and the record after it together
+        __atomic_store_n(&ring->tail, tail + ring->capacity - index, __ATOMIC_RELEASE);
+        index = 0;
+    }
+    *len = (size_t)*(uint64_t*)(ring->data + index);
+    return ring->data + index + sizeof(uint64_t);
+}
+
+void defer_ring_release(defer_ring_t* ring) {
+    uint64_t tail = ring->tail;
+    uint64_t index = tail & (ring->capacity - 1);
+    __atomic_store_n(&ring->tail, tail + defer_ring_record(*(uint64_t*)(ring->data + index)), __ATOMIC_RELEASE);
+}
+
+int defer_tmpfile_open(const char* dir) {
+    int fd;
+#if defined(O_TMPFILE)
+    fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0 || (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL)) {
+        return fd;
+    }
+#endif
+    // Kernel or filesystem without O_TMPFILE
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/.defer_tmp_XXXXXX", dir) >= (int)sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    fd = mkstemp(path);
+    if (fd < 0) {
+        return -1;
+    }
+    unlink(path);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+// Random suffix for a temporary name, different for every call
+static unsigned long long defer_tmpname_suffix(void) {
+    static unsigned long long counter = 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    unsigned long long x = ((unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec) ^
+                           ((unsigned long long)getpid() << 32) ^ (unsigned long long)(uintptr_t)&ts ^
+                           (__atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED) * 0x9e3779b97f4a7c15ULL);
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+int defer_tmpfile_link(int fd, const char* path) {
+#if defined(__linux__) && defined(AT_SYMLINK_FOLLOW)
+    char source[64], temp[PATH_MAX];
+    snprintf(source, sizeof(source), "/proc/self/fd/%d", fd);
+    // Link under a fresh temporary name, then rename over the target. The
+    // name is never one somebody else created: linkat() fails on EEXIST.
+    int linked = -1;
+    for (int attempt = 0; attempt < 100 && linked != 0; attempt++) {
+        if (snprintf(temp, sizeof(temp), "%s.%012llx.tmp", path, defer_tmpname_suffix() & 0xffffffffffffULL) >=
+            (int)sizeof(temp)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        linked = linkat(AT_FDCWD, source, AT_FDCWD, temp, AT_SYMLINK_FOLLOW);
+        if (linked != 0 && errno != EEXIST) {
+            return -1;
+        }
+    }
+    if (linked != 0) {
+        return -1;
+    }
+    int result = rename(temp, path);
+    int error = errno;
+    // rename() fails, or leaves both names when path is already this file;
+    // either way the temporary name is still the one linked above
+    struct stat file, name;
+    if (result != 0 || (fstat(fd, &file) == 0 && lstat(temp, &name) == 0 && file.st_dev == name.st_dev &&
+                        file.st_ino == name.st_ino)) {
+        unlink(temp);
+    }
+    errno = error;
+    return result;
+#else
+    (void)fd;
+    (void)path;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+int defer_tmpdir_create(defer_tmpdir_t* dir, const char* parent) {
+    dir->fd = -1;
+    dir->parent_fd = -1;
+    dir->name[0] = '\0';
+    if (!parent) {
+        parent = getenv("TMPDIR");
+        parent = parent && *parent ? parent : "/tmp";
+    }
+    if (snprintf(dir->path, sizeof(dir->path), "%s/defer.XXXXXX", parent) >= (int)sizeof(dir->path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    dir->parent_fd = open(parent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir->parent_fd < 0) {
+        return -1;
+    }
+    if (!mkdtemp(dir->path)) {
+        defer_tmpdir_remove(dir);
+        return -1;
+    }
+    strcpy(dir->name, strrchr(dir->path, '/') + 1);
+    dir->fd = openat(dir->parent_fd, dir->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (dir->fd < 0) {
+        int error = errno;
+        unlinkat(dir->parent_fd, dir->name, AT_REMOVEDIR);
+        dir->name[0] = '\0';
+        defer_tmpdir_remove(dir);
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+// Removes everything inside the directory open at `fd`
+static int defer_remove_contents(int fd) {
+    int scan = openat(fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (scan < 0) {
+        return -1;
+    }
+    DIR* entries = fdopendir(scan);
+    if (!entries) {
+        close(scan);
+        return -1;
+    }
+    int result = 0;
+    struct dirent* entry;
+    while ((entry = readdir(entries)) != NULL) {
+        const char* name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+#ifdef DT_DIR
+        int is_dir = entry->d_type == DT_DIR;
+#else
+        int is_dir = 0;
+#endif
+        if (!is_dir && unlinkat(fd, name, 0) == 0) {
+            continue;
+        }
+        // Unknown entry types are tried as files first
+        if (!is_dir && errno != EISDIR && errno != EPERM) {
+            result = -1;
+            continue;
+        }
+        int sub = openat(fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (sub < 0) {
+            result = -1;
+            continue;
+        }
+        if (defer_remove_contents(sub) != 0) {
+            result = -1;
+        }
+        close(sub);
+        if (unlinkat(fd, name, AT_REMOVEDIR) != 0) {
+            result = -1;
+        }
+    }
+    closedir(entries);
+    return result;
+}
+
+int defer_tmpdir_remove(defer_tmpdir_t* dir) {
+    int result = 0;
+    if (dir->fd >= 0) {
+        if (defer_remove_contents(dir->fd) != 0) {
+            result = -1;
+        }
+        close(dir->fd);
+        dir->fd = -1;
+    }
+    if (dir->parent_fd >= 0) {
+        if (dir->name[0] && unlinkat(dir->parent_fd, dir->name, AT_REMOVEDIR) != 0) {
+            result = -1;
+        }
+        close(dir->parent_fd);
+        dir->parent_fd = -1;
+    }
+    dir->name[0] = '\0';
+    return result;
+}
+
+void cleanup_tmpdir(void* ptr) {
+    defer_tmpdir_remove((defer_tmpdir_t*)ptr);
+}
+
+void* defer_alloc_huge_enter(defer_alloc_t* alloc, size_t size) {
+    const size_t huge = DEFER_HUGE_PAGE_SIZE;
+    alloc->ptr = NULL;
+    alloc->size = 0;
+    alloc->kind = DEFER_ALLOC_NONE;
+    size_t rounded = (size + huge - 1) & ~(huge - 1);
+    if (size == 0 || rounded < size || rounded + huge < rounded) {
+        errno = size == 0 ? EINVAL : ENOMEM;
+        return NULL;
+    }
+#ifdef MAP_HUGETLB
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_SHIFT
+    // Ask for this page size, not the system default, so munmap's length matches
+    flags |= __builtin_ctzl(huge) << MAP_HUGE_SHIFT;
+#endif
+    void* mem = mmap(NULL, rounded, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (mem != MAP_FAILED) {
+        alloc->ptr = mem;
+        alloc->size = rounded;
+        alloc->kind = DEFER_ALLOC_HUGETLB;
+        return mem;
+    }
+#endif
+    // Over-map by one huge page and trim, so the region starts on a
+    // huge-page boundary where THP can back it
+    char* raw = (char*)mmap(NULL, rounded + huge, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == (char*)MAP_FAILED) {
+        return NULL;
+    }
+    char* start = (char*)(((uintptr_t)raw + huge - 1) & ~(uintptr_t)(huge - 1));
+    if (start > raw) {
+        munmap(raw, (size_t)(start - raw));
+    }
+    if (raw + huge > start) {
+        munmap(start + rounded, (size_t)(raw + huge - start));
+    }
+    alloc->ptr = start;
+    alloc->size = rounded;
+    alloc->kind = DEFER_ALLOC_PAGES;
+#ifdef MADV_HUGEPAGE
+    if (madvise(start, rounded, MADV_HUGEPAGE) == 0) {
+        alloc->kind = DEFER_ALLOC_THP;
+    }
+#endif
+    return start;
+}
+
+#endif // DEFER_POSIX
+
 #endif // DEFER_IMPLEMENTATION
 
 #endif // DEFER_H
\ No newline at end of file
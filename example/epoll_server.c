@@ -0,0 +1,577 @@
+/**
+ * @file epoll_server.c
+ * @brief Example of using defer on the hot path of a non-blocking epoll server
+ *
+ * A small line-based key/value server. Every per-connection resource (the
+ * socket, an idle timerfd, the input and output buffers and the connection
+ * itself) is owned through defer, both while a connection is being set up
+ * and when it is torn down.
+ *
+ * Protocol, one request per line:
+ *   SET <key> <value>  ->  OK
+ *   GET <key>          ->  VALUE <value> | NOTFOUND
+ *   anything else      ->  echoed back
+ *
+ * Replies are never cut short: while the output buffer cannot hold another
+ * whole reply, buffered requests wait and the socket is not read, so a
+ * client pipelining faster than it reads is pushed back on by TCP.
+ *
+ * Build with -DEPOLL_SERVER_MANUAL for the same server with the
+ * per-connection defers replaced by explicit cleanup on each path;
+ * bench-net runs both as a baseline.
+ *
+ * Usage:
+ *   epoll_server          Run a short self-contained demo
+ *   epoll_server <port>   Serve on 127.0.0.1:<port> until SIGINT/SIGTERM
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFER_IMPLEMENTATION
+#include "../defer.h"
+
+#ifdef __linux__
+
+#include <stdint.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define BUFFER_SIZE 16384
+// The longest reply is an echoed line of up to BUFFER_SIZE - 2 bytes plus
+// its newline, so a line is only handled while BUFFER_SIZE bytes are free
+#define OUTPUT_SIZE (2 * BUFFER_SIZE)
+#define IDLE_TIMEOUT_SEC 30
+#define MAX_EVENTS 256
+#define STORE_SLOTS 65536
+#define KEY_SIZE 64
+#define VALUE_SIZE 256
+
+typedef struct connection {
+    int fd;
+    int timer_fd;
+    char* in;
+    size_t in_len;
+    char* out;
+    size_t out_len;
+    size_t out_sent;
+    int writing;                   // Waiting for EPOLLOUT; reads are paused
+    struct connection* prev;       // Open connections, closed on shutdown
+    struct connection* next;
+} connection_t;
+
+// epoll data for a connection's timerfd is the connection pointer with the
+// low bit set, so one lookup serves both descriptors
+#define TIMER_TAG ((uintptr_t)1)
+
+typedef struct {
+    char key[KEY_SIZE];
+    char value[VALUE_SIZE];
+    int used;
+} store_entry_t;
+
+static store_entry_t store[STORE_SLOTS];
+static connection_t* connections = NULL;
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+// Slot holding `key` or the free slot where it belongs; -1 if the store is full
+static long store_slot(const char* key) {
+    // FNV-1a; similar keys must not land in neighbouring slots
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char* p = key; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+    }
+    hash ^= hash >> 32;
+    for (size_t probe = 0; probe < STORE_SLOTS; probe++) {
+        size_t slot = (size_t)((hash + probe) % STORE_SLOTS);
+        if (!store[slot].used || strcmp(store[slot].key, key) == 0) {
+            return (long)slot;
+        }
+    }
+    return -1;
+}
+
+// Callers check output_has_room() first, so a reply always fits whole
+static void append_output(connection_t* conn, const char* data, size_t len) {
+    memcpy(conn->out + conn->out_len, data, len);
+    conn->out_len += len;
+}
+
+static int output_has_room(const connection_t* conn) {
+    return OUTPUT_SIZE - conn->out_len >= BUFFER_SIZE;
+}
+
+static void handle_line(connection_t* conn, char* line) {
+    char key[KEY_SIZE], value[VALUE_SIZE];
+    char reply[VALUE_SIZE + 16];
+
+    if (sscanf(line, "SET %63s %255s", key, value) == 2) {
+        long slot = store_slot(key);
+        if (slot < 0) {
+            append_output(conn, "FULL\n", 5);
+            return;
+        }
+        snprintf(store[slot].key, KEY_SIZE, "%s", key);
+        snprintf(store[slot].value, VALUE_SIZE, "%s", value);
+        store[slot].used = 1;
+        append_output(conn, "OK\n", 3);
+    } else if (sscanf(line, "GET %63s", key) == 1) {
+        long slot = store_slot(key);
+        int n = slot >= 0 && store[slot].used ? snprintf(reply, sizeof(reply), "VALUE %s\n", store[slot].value)
+                                 : snprintf(reply, sizeof(reply), "NOTFOUND\n");
+        append_output(conn, reply, (size_t)n);
+    } else {
+        append_output(conn, line, strlen(line));
+        append_output(conn, "\n", 1);
+    }
+}
+
+// Push the idle deadline back; runs at the end of every readable event
+static void rearm_idle_timer(void* arg) {
+    connection_t* conn = (connection_t*)arg;
+    struct itimerspec spec = { { 0, 0 }, { IDLE_TIMEOUT_SEC, 0 } };
+    timerfd_settime(conn->timer_fd, 0, &spec, NULL);
+}
+
+#ifndef EPOLL_SERVER_MANUAL
+static void free_connection(void* arg) {
+    connection_t** conn = (connection_t**)arg;
+    if (*conn) {
+        free((*conn)->in);
+        free((*conn)->out);
+        free(*conn);
+    }
+}
+#endif
+
+static void unlink_connection(connection_t* conn) {
+    if (conn->prev) {
+        conn->prev->next = conn->next;
+    } else {
+        connections = conn->next;
+    }
+    if (conn->next) {
+        conn->next->prev = conn->prev;
+    }
+}
+
+#ifndef EPOLL_SERVER_MANUAL
+static void close_connection(connection_t* conn) {
+    unlink_connection(conn);
+    // Released in reverse order: timer, socket, then buffers and the connection
+    defer(free_connection, &conn);
+    defer_close(&conn->fd);
+    defer_close(&conn->timer_fd);
+}
+#else
+static void close_connection(connection_t* conn) {
+    unlink_connection(conn);
+    close(conn->timer_fd);
+    close(conn->fd);
+    free(conn->in);
+    free(conn->out);
+    free(conn);
+}
+#endif
+
+// Runs when the server loop exits, so no connection outlives it
+static void close_all_connections(void* arg) {
+    connection_t** list = (connection_t**)arg;
+    while (*list) {
+        close_connection(*list);
+    }
+}
+
+#ifndef EPOLL_SERVER_MANUAL
+static int accept_connection(int epoll_fd, int listener) {
+    int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    // Everything below is released on any early return; on success the
+    // ownership moves into the epoll registration and the locals are cleared
+    defer_close(&fd);
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    connection_t* conn = calloc(1, sizeof(connection_t));
+    if (!conn) {
+        return -1;
+    }
+    defer(free_connection, &conn);
+    conn->fd = conn->timer_fd = -1;
+
+    conn->in = malloc(BUFFER_SIZE);
+    conn->out = malloc(OUTPUT_SIZE);
+    if (!conn->in || !conn->out) {
+        return -1;
+    }
+
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0) {
+        return -1;
+    }
+    defer_close(&timer_fd);
+
+    struct epoll_event ev = { EPOLLIN | EPOLLRDHUP, { .ptr = conn } };
+    struct epoll_event tev = { EPOLLIN, { .ptr = (void*)((uintptr_t)conn | TIMER_TAG) } };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &tev) != 0) {
+        return -1;
+    }
+
+    conn->fd = fd;
+    conn->timer_fd = timer_fd;
+    conn->next = connections;
+    if (connections) {
+        connections->prev = conn;
+    }
+    connections = conn;
+    rearm_idle_timer(conn);
+    fd = timer_fd = -1;
+    conn = NULL;
+    return 0;
+}
+#else
+static int accept_connection(int epoll_fd, int listener) {
+    int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    int timer_fd = -1;
+    connection_t* conn = calloc(1, sizeof(connection_t));
+    if (!conn) {
+        goto fail;
+    }
+    conn->in = malloc(BUFFER_SIZE);
+    conn->out = malloc(OUTPUT_SIZE);
+    if (!conn->in || !conn->out) {
+        goto fail;
+    }
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0) {
+        goto fail;
+    }
+    struct epoll_event ev = { EPOLLIN | EPOLLRDHUP, { .ptr = conn } };
+    struct epoll_event tev = { EPOLLIN, { .ptr = (void*)((uintptr_t)conn | TIMER_TAG) } };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &tev) != 0) {
+        goto fail;
+    }
+
+    conn->fd = fd;
+    conn->timer_fd = timer_fd;
+    conn->next = connections;
+    if (connections) {
+        connections->prev = conn;
+    }
+    connections = conn;
+    rearm_idle_timer(conn);
+    return 0;
+
+fail:
+    if (timer_fd >= 0) {
+        close(timer_fd);
+    }
+    if (conn) {
+        free(conn->in);
+        free(conn->out);
+        free(conn);
+    }
+    close(fd);
+    return -1;
+}
+#endif
+
+// Handles the complete lines buffered in `in` while the output buffer has
+// room for another reply; returns the number handled
+static size_t process_input(connection_t* conn) {
+    size_t handled = 0;
+    char* line = conn->in;
+    char* newline;
+    conn->in[conn->in_len] = '\0';
+    while (output_has_room(conn) && (newline = strchr(line, '\n')) != NULL) {
+        *newline = '\0';
+        handle_line(conn, line);
+        line = newline + 1;
+        handled++;
+    }
+    conn->in_len -= (size_t)(line - conn->in);
+    memmove(conn->in, line, conn->in_len);
+    return handled;
+}
+
+static int set_interest(int epoll_fd, connection_t* conn, int writing) {
+    if (conn->writing == writing) {
+        return 0;
+    }
+    // While writing, only EPOLLOUT is watched: input waits in the socket
+    struct epoll_event ev = { writing ? EPOLLOUT : EPOLLIN | EPOLLRDHUP, { .ptr = conn } };
+    conn->writing = writing;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+// Returns -1 when the connection should be closed
+static int flush_output(int epoll_fd, connection_t* conn) {
+    do {
+        while (conn->out_sent < conn->out_len) {
+            ssize_t n = send(conn->fd, conn->out + conn->out_sent, conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EAGAIN) {
+                return set_interest(epoll_fd, conn, 1);
+            }
+            if (n < 0) {
+                return -1;
+            }
+            conn->out_sent += (size_t)n;
+        }
+        conn->out_len = conn->out_sent = 0;
+        // Requests that waited for room while the output buffer was full
+    } while (process_input(conn) > 0);
+    return set_interest(epoll_fd, conn, 0);
+}
+
+static int read_input(int epoll_fd, connection_t* conn) {
+    for (;;) {
+        process_input(conn);
+        if (!output_has_room(conn)) {
+            break;  // Stop reading until the replies drain
+        }
+        if (conn->in_len == BUFFER_SIZE - 1) {
+            return -1;  // Line too long
+        }
+        ssize_t n = recv(conn->fd, conn->in + conn->in_len, BUFFER_SIZE - 1 - conn->in_len, 0);
+        if (n < 0 && errno == EAGAIN) {
+            break;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        conn->in_len += (size_t)n;
+    }
+    return flush_output(epoll_fd, conn);
+}
+
+#ifndef EPOLL_SERVER_MANUAL
+static int handle_readable(int epoll_fd, connection_t* conn) {
+    defer(rearm_idle_timer, conn);
+    return read_input(epoll_fd, conn);
+}
+#else
+static int handle_readable(int epoll_fd, connection_t* conn) {
+    int result = read_input(epoll_fd, conn);
+    rearm_idle_timer(conn);
+    return result;
+}
+#endif
+
+static int open_listener(int port, int* bound_port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 1024) != 0 ||
+        getsockname(fd, (struct sockaddr*)&addr, &len) != 0) {
+        close(fd);
+        return -1;
+    }
+    *bound_port = ntohs(addr.sin_port);
+    return fd;
+}
+
+// Serve until stop_requested is set
+static int run_server(int listener) {
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        return 1;
+    }
+    defer_close(&epoll_fd);
+
+    struct epoll_event ev = { EPOLLIN, { .ptr = NULL } };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listener, &ev) != 0) {
+        return 1;
+    }
+    defer(close_all_connections, &connections);
+
+    struct epoll_event events[MAX_EVENTS];
+    while (!stop_requested) {
+        int count = epoll_wait(epoll_fd, events, MAX_EVENTS, 100);
+        for (int i = 0; i < count; i++) {
+            if (events[i].events == 0) {
+                continue;  // Connection already closed in this batch
+            }
+            if (events[i].data.ptr == NULL) {
+                while (accept_connection(epoll_fd, listener) == 0) {
+                }
+                continue;
+            }
+
+            uintptr_t tag = (uintptr_t)events[i].data.ptr;
+            connection_t* conn = (connection_t*)(tag & ~TIMER_TAG);
+            int result;
+            if (tag & TIMER_TAG) {
+                result = -1;  // Idle timeout
+            } else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                result = -1;
+            } else if (events[i].events & EPOLLOUT) {
+                result = flush_output(epoll_fd, conn);
+            } else {
+                result = handle_readable(epoll_fd, conn);
+            }
+            if (result != 0) {
+                // Later events in this batch may refer to the same connection
+                for (int j = i + 1; j < count; j++) {
+                    if (((uintptr_t)events[j].data.ptr & ~TIMER_TAG) == (uintptr_t)conn) {
+                        events[j].events = 0;
+                    }
+                }
+                close_connection(conn);
+            }
+        }
+    }
+    return 0;
+}
+
+static void* server_thread(void* arg) {
+    run_server(*(int*)arg);
+    return NULL;
+}
+
+// Demo: start the server on an ephemeral port and talk to it
+static int run_demo(void) {
+    int port;
+    int listener = open_listener(0, &port);
+    if (listener < 0) {
+        printf("Failed to open listener\n");
+        return 1;
+    }
+    defer_close(&listener);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, server_thread, &listener) != 0) {
+        return 1;
+    }
+
+    printf("Server listening on 127.0.0.1:%d\n", port);
+    {
+        int client = socket(AF_INET, SOCK_STREAM, 0);
+        if (client < 0) {
+            printf("Failed to create client socket\n");
+            return 1;
+        }
+        defer_close(&client);
+
+        struct sockaddr_in addr = {0};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((unsigned short)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(client, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            printf("Failed to connect\n");
+            return 1;
+        }
+
+        const char* requests[] = { "SET greeting hello\n", "GET greeting\n", "GET missing\n", "ping\n" };
+        for (size_t i = 0; i < sizeof(requests) / sizeof(requests[0]); i++) {
+            char reply[512];
+            send(client, requests[i], strlen(requests[i]), 0);
+            ssize_t n = recv(client, reply, sizeof(reply) - 1, 0);
+            reply[n > 0 ? n : 0] = '\0';
+            printf("> %s< %s", requests[i], reply);
+        }
+
+        // Pipelined GETs of a long value: the replies far outgrow the
+        // output buffer, and every one must still arrive whole
+        char set[VALUE_SIZE + 16];
+        char value[VALUE_SIZE - 1];
+        memset(value, 'v', sizeof(value) - 1);
+        value[sizeof(value) - 1] = '\0';
+        int set_len = snprintf(set, sizeof(set), "SET big %s\n", value);
+        char ok[8];
+        if (send(client, set, (size_t)set_len, 0) != set_len || recv(client, ok, 3, MSG_WAITALL) != 3) {
+            printf("Failed to store the long value\n");
+            return 1;
+        }
+        enum { PIPELINED = 1000 };
+        char gets[PIPELINED * 8];
+        for (int i = 0; i < PIPELINED; i++) {
+            memcpy(gets + i * 8, "GET big\n", 8);
+        }
+        if (send(client, gets, sizeof(gets), 0) != (ssize_t)sizeof(gets)) {
+            printf("Failed to send pipelined requests\n");
+            return 1;
+        }
+        size_t reply_len = strlen("VALUE ") + strlen(value) + 1;
+        int whole = 0;
+        char reply[VALUE_SIZE + 16];
+        while (whole < PIPELINED && recv(client, reply, reply_len, MSG_WAITALL) == (ssize_t)reply_len) {
+            if (strncmp(reply, "VALUE ", 6) != 0 || reply[reply_len - 1] != '\n') {
+                break;
+            }
+            whole++;
+        }
+        printf("Pipelined %d GETs: %d whole replies (%zu bytes)\n", PIPELINED, whole, (size_t)whole * reply_len);
+        if (whole != PIPELINED) {
+            return 1;
+        }
+    }
+
+    // The server may stop before it sees the client's close; it then
+    // releases every connection still registered on the way out
+    stop_requested = 1;
+    pthread_join(thread, NULL);
+    printf("Server stopped, all connections released\n");
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        return run_demo();
+    }
+
+    int port;
+    int listener = open_listener(atoi(argv[1]), &port);
+    if (listener < 0) {
+        printf("Failed to listen on port %s\n", argv[1]);
+        return 1;
+    }
+    defer_close(&listener);
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    signal(SIGPIPE, SIG_IGN);
+    printf("Serving on 127.0.0.1:%d\n", port);
+    fflush(stdout);
+    return run_server(listener);
+}
+
+#else
+
+int main(void) {
+    printf("The epoll server example requires Linux\n");
+    return 0;
+}
+
+#endif
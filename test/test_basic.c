@@ -96,4 +96,170 @@ void test_multiple_defers(void) {
     
     printf("Both defers registered\n");
     print_success("Multiple defers test completed");
-} 
\ No newline at end of file
+} 
+
+// Cleanup bound at compile time for the compact defer test
+static void mark_cleaned(void* arg) {
+    (*(int*)arg)++;
+}
+
+DEFER_COMPACT_THUNK(mark_cleaned_thunk, mark_cleaned)
+
+void test_compact_defer(void) {
+    printf("\n=== Testing Compact Defers ===\n");
+
+    int outer = 0, inner = 0;
+    {
+        defer_compact(mark_cleaned_thunk, &outer);
+        {
+            defer_compact(mark_cleaned_thunk, &inner);
+            defer_compact(mark_cleaned_thunk, NULL);  // Skipped like defer()
+        }
+        if (inner != 1 || outer != 0) {
+            print_error("Compact defer ran at the wrong scope exit");
+            return;
+        }
+    }
+    if (outer != 1) {
+        print_error("Compact defer did not run");
+        return;
+    }
+    if (sizeof(void*) >= sizeof(defer_data_t)) {
+        print_error("Compact defer slot is not smaller than defer_data_t");
+        return;
+    }
+    print_success("Compact defer test completed");
+}
+
+static float scale(float value, float factor) {
+    volatile float v = value, f = factor;  // Keep the arithmetic at run time
+    return v * f;
+}
+
+void test_fp_scopes(void) {
+    printf("\n=== Testing defer_fp_fast/defer_fp_round ===\n");
+
+    const float denormal = 1e-39f;
+    int round = fegetround();
+    feclearexcept(FE_INEXACT);
+    {
+        defer_fp_fast();
+#ifdef DEFER_FP_FAST_BITS
+        if (scale(denormal, 1.0f) != 0.0f) {
+            print_error("Denormal was not flushed inside defer_fp_fast");
+            return;
+        }
+#endif
+        {
+            defer_fp_round(FE_UPWARD);
+            if (fegetround() != FE_UPWARD || scale(1.0f, 1.0f / 3.0f) * 3.0f <= 1.0f) {
+                print_error("defer_fp_round did not apply FE_UPWARD");
+                return;
+            }
+        }
+        if (fegetround() != round) {
+            print_error("Rounding mode was not restored");
+            return;
+        }
+    }
+    if (scale(denormal, 1.0f) == 0.0f) {
+        print_error("Flush-to-zero was not restored");
+        return;
+    }
+    if (!fetestexcept(FE_INEXACT)) {
+        print_error("Exception flags raised inside the scope were lost");
+        return;
+    }
+    print_success("Floating-point scopes applied and restored");
+}
+
+typedef struct {
+    int runs;
+} once_counter_t;
+
+static void count_once(void* ptr) {
+    ((once_counter_t*)ptr)->runs++;
+}
+
+static void once_helper(once_counter_t* counter, int depth) {
+    int before = counter->runs;
+    defer_once(count_once, counter);
+    if (depth > 0) {
+        once_helper(counter, depth - 1);
+    }
+    if (counter->runs != before) {
+        print_error("defer_once ran before the outermost scope exited");
+    }
+}
+
+static void once_throw(once_counter_t* counter) {
+    defer_once(count_once, counter);
+    once_helper(counter, 2);
+    defer_throw(1);
+}
+
+// Keeps count pairs active at once, each registered twice
+static void once_hold(once_counter_t* counters, int count) {
+    if (count == 0) {
+        return;
+    }
+    defer_once(count_once, &counters[0]);
+    defer_once(count_once, &counters[0]);
+    once_hold(counters + 1, count - 1);
+}
+
+void test_once_defer(void) {
+    printf("\n=== Testing defer_once ===\n");
+
+    // Nested registrations of one pair collapse into the outermost scope
+    once_counter_t shared = { 0 }, other = { 0 };
+    {
+        defer_once(count_once, &shared);
+        once_helper(&shared, 3);
+        defer_once(count_once, &other);
+        if (shared.runs != 0 || other.runs != 0) {
+            print_error("defer_once ran inside the owning scope");
+            return;
+        }
+    }
+    if (shared.runs != 1 || other.runs != 1) {
+        print_error("Duplicate defer_once pairs did not run exactly once");
+        return;
+    }
+
+    // Once the owner exits, the pair can be registered again
+    once_helper(&shared, 1);
+    if (shared.runs != 2) {
+        print_error("defer_once did not run after re-registration");
+        return;
+    }
+
+    // A throw runs the owner once and releases the pair
+    volatile int caught = 0;
+    defer_try {
+        once_throw(&shared);
+    } defer_catch(err) {
+        caught = err;
+    }
+    if (caught != 1 || shared.runs != 3) {
+        print_error("defer_throw did not run the defer_once owner once");
+        return;
+    }
+    once_helper(&shared, 0);
+    if (shared.runs != 4 || defer_unwind_top != NULL) {
+        print_error("defer_once pair leaked past a throw");
+        return;
+    }
+
+    // Past the set's capacity pairs stop coalescing but still run
+    once_counter_t many[DEFER_ONCE_SLOTS];
+    memset(many, 0, sizeof(many));
+    once_hold(many, DEFER_ONCE_SLOTS);
+    for (int i = 0; i < DEFER_ONCE_SLOTS; i++) {
+        if (many[i].runs < 1 || (i < DEFER_ONCE_SLOTS / 2 && many[i].runs != 1)) {
+            print_error("defer_once lost or repeated a cleanup with the set full");
+            return;
+        }
+    }
+    print_success("defer_once test completed");
+}
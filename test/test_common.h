@@ -84,6 +84,12 @@ void test_basic_memory(void);
 void test_basic_file(void);
 void test_basic_string(void);
 void test_multiple_defers(void);
+void test_compact_defer(void);
+void test_fp_scopes(void);
+void test_once_defer(void);
+void test_mem_scope(void);
+void test_alloc_helpers(void);
+void test_try_throw(void);
 void test_resource_cleanup(void);
 void test_string_operations(void);
 void test_array_operations(void);
@@ -99,6 +105,23 @@ void test_nested_scope_allocation(void);
 void test_database_connection(void);
 void test_mutex_locking(void);
 void test_opengl_resources(void);
+void test_streaming_reader(void);
+void test_direct_reader(void);
+void test_buffered_writer(void);
+void test_group_fsync(void);
+void test_sendfile_transfer(void);
+void test_tmpfile_tmpdir(void);
+void test_nursery_spawn(void);
+void test_nursery_errors(void);
+void test_thread_exit(void);
+void test_shutdown_mode(void);
+void test_biased_unref(void);
+void test_tick_queue(void);
+void test_handle_pool(void);
+void test_handle_table(void);
+void test_cpu_scopes(void);
+void test_mlock_scope(void);
+void test_shm_ring(void);
 
 // Utility function declarations
 void print_error(const char* message);
@@ -0,0 +1,1206 @@
+/**
+ * @file test_concurrency.c
+ * @brief Threading and concurrency helper tests for defer.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_common.h"
+#include "../defer.h"
+
+#ifndef _WIN32
+#include <sys/wait.h>
+
+static int count_task(void* arg) {
+    __atomic_fetch_add((long*)arg, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+typedef struct {
+    long depth;
+    long* leaves;
+} tree_node_t;
+
+// Spawns two children into a nested nursery until depth runs out, so
+// workers end up joining inside tasks and stealing from each other
+static int tree_task(void* arg) {
+    tree_node_t* node = (tree_node_t*)arg;
+    if (node->depth == 0) {
+        __atomic_fetch_add(node->leaves, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    tree_node_t children[2] = {
+        { node->depth - 1, node->leaves },
+        { node->depth - 1, node->leaves },
+    };
+    defer_nursery(nursery);
+    nursery_spawn(tree_task, &children[0]);
+    nursery_spawn(tree_task, &children[1]);
+    return nursery_join(&nursery);
+}
+
+static int fail_task(void* arg) {
+    return *(int*)arg;
+}
+
+static int wait_cancel_task(void* arg) {
+    // Runs until a sibling's failure cancels the nursery
+    while (!nursery_cancelled()) {
+        usleep(100);
+    }
+    __atomic_fetch_add((long*)arg, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void test_nursery_spawn(void) {
+    printf("\n=== Testing Nursery Spawn and Join ===\n");
+
+    long counter = 0;
+    {
+        defer_nursery(nursery);
+        for (int i = 0; i < 1000; i++) {
+            if (nursery_spawn(count_task, &counter) != 0) {
+                print_error("nursery_spawn failed");
+                return;
+            }
+        }
+    }
+    if (counter != 1000) {
+        print_error("Nursery scope exit did not wait for all tasks");
+        return;
+    }
+
+    long leaves = 0;
+    tree_node_t root = { 10, &leaves };
+    {
+        defer_nursery(nursery);
+        nursery_spawn(tree_task, &root);
+        if (nursery_join(&nursery) != 0 || leaves != 1024) {
+            print_error("Nested nurseries did not run every task");
+            return;
+        }
+    }
+
+    if (nursery_spawn(count_task, &counter) != -1 || errno != EINVAL) {
+        print_error("nursery_spawn outside a nursery should fail with EINVAL");
+        return;
+    }
+    print_success("Nursery spawn and join test completed");
+}
+
+void test_nursery_errors(void) {
+    printf("\n=== Testing Nursery Errors and Cancellation ===\n");
+
+    int error = 42;
+    long observed = 0;
+    defer_nursery(nursery);
+    nursery_spawn(wait_cancel_task, &observed);
+    nursery_spawn(fail_task, &error);
+    if (nursery_join(&nursery) != 1) {
+        print_error("Failed task was not counted");
+        return;
+    }
+    if (!nursery.errors || nursery.errors->error != 42 || nursery.errors->arg != &error || nursery.errors->next) {
+        print_error("Failed task was not recorded");
+        return;
+    }
+    if (observed != 1) {
+        print_error("Sibling task did not observe cancellation");
+        return;
+    }
+    if (nursery_spawn(count_task, &observed) != -1 || errno != ECANCELED) {
+        print_error("Spawn into a cancelled nursery should fail with ECANCELED");
+        return;
+    }
+
+    {
+        // Cancellation reaches nurseries opened inside the cancelled one
+        defer_nursery(inner);
+        if (nursery_spawn(count_task, &observed) != -1 || inner.skipped != 1) {
+            print_error("Nested nursery ignored the enclosing cancellation");
+            return;
+        }
+    }
+    print_success("Nursery error collection test completed");
+}
+
+typedef struct {
+    int order[40];
+    int count;
+} exit_log_t;
+
+typedef struct {
+    exit_log_t* log;
+    int id;
+} exit_entry_t;
+
+static void log_exit(void* arg) {
+    exit_entry_t* entry = (exit_entry_t*)arg;
+    entry->log->order[entry->log->count++] = entry->id;
+}
+
+static void* exit_thread(void* arg) {
+    exit_entry_t* entries = (exit_entry_t*)arg;
+    // More entries than DEFER_THREAD_EXIT_INLINE to spill into a chunk
+    for (int i = 0; i < 40; i++) {
+        if (defer_thread_exit(log_exit, &entries[i]) != 0) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+void test_thread_exit(void) {
+    printf("\n=== Testing Thread-Exit Defers ===\n");
+
+    exit_log_t log = { {0}, 0 };
+    exit_entry_t entries[40];
+    for (int i = 0; i < 40; i++) {
+        entries[i] = (exit_entry_t){ &log, i };
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, exit_thread, entries) != 0) {
+        print_error("Failed to create thread");
+        return;
+    }
+    pthread_join(thread, NULL);
+    if (log.count != 40) {
+        print_error("Not every thread-exit defer ran");
+        return;
+    }
+    for (int i = 0; i < 40; i++) {
+        if (log.order[i] != 39 - i) {
+            print_error("Thread-exit defers did not run in LIFO order");
+            return;
+        }
+    }
+
+    // The main thread never runs key destructors; flush explicitly
+    log.count = 0;
+    defer_thread_exit(log_exit, &entries[0]);
+    defer_thread_exit(log_exit, &entries[1]);
+    defer_thread_exit_run();
+    if (log.count != 2 || log.order[0] != 1 || log.order[1] != 0) {
+        print_error("defer_thread_exit_run did not run pending defers");
+        return;
+    }
+    print_success("Thread-exit defer test completed");
+}
+
+static int shutdown_pipe = -1;
+
+static void report_exit(void* arg) {
+    char c = *(const char*)arg;
+    if (write(shutdown_pipe, &c, 1) != 1) {
+        _exit(2);
+    }
+}
+
+static void count_cleanup(void* arg) {
+    (*(int*)arg)++;
+}
+
+static void shutdown_child(void) {
+    // Ordered teardown: priority 5 first, then the priority 0 entries LIFO
+    static const char names[] = "abcd";
+    defer_atexit(report_exit, (void*)&names[0], 0);
+    defer_atexit(report_exit, (void*)&names[1], 5);
+    defer_atexit(report_exit, (void*)&names[2], 0);
+    defer_atexit(report_exit, (void*)&names[3], -1);
+
+    int reclaimed = 0, external = 0;
+    defer_alloc_t alloc = { NULL, 0, DEFER_ALLOC_NONE };
+    void* aligned = NULL;
+    defer_shm_t shm;
+    char* mapped = NULL;
+    if (defer_shm_create(&shm, NULL, 4096) == 0) {
+        mapped = (char*)shm.addr;
+    }
+    defer_set_exiting();
+    {
+        defer_reclaimable(count_cleanup, &reclaimed);
+        defer(count_cleanup, &external);
+        defer_free(malloc(16));
+        aligned = defer_alloc_aligned(&alloc, 64, 256);
+        if (mapped) {
+            defer_shm(&shm);
+        }
+    }
+    // The allocation and mapping are left to the kernel; the fd is closed
+    int kept = aligned && alloc.ptr == aligned && (!mapped || (mapped[0] == 0 && shm.fd == -1));
+    char c = (reclaimed == 0 && external == 1 && kept && defer_exiting()) ? 'y' : 'n';
+    report_exit(&c);
+    exit(0);
+}
+
+void test_shutdown_mode(void) {
+    printf("\n=== Testing Fast Shutdown Mode ===\n");
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        print_error("Failed to create pipe");
+        return;
+    }
+    defer_close(&fds[0]);
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[1]);
+        print_error("Failed to fork");
+        return;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        shutdown_pipe = fds[1];
+        shutdown_child();
+    }
+    close(fds[1]);
+
+    char out[8] = {0};
+    size_t got = 0;
+    ssize_t n;
+    while (got < sizeof(out) - 1 && (n = read(fds[0], out + got, sizeof(out) - 1 - got)) > 0) {
+        got += (size_t)n;
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        print_error("Shutdown child failed");
+        return;
+    }
+    if (strcmp(out, "ybcad") != 0) {
+        print_error("Reclaimable cleanups or atexit order were wrong");
+        return;
+    }
+    if (defer_exiting()) {
+        print_error("Exiting state leaked into the parent");
+        return;
+    }
+    print_success("Fast shutdown mode test completed");
+}
+
+static void count_destroy(void* arg) {
+    __atomic_fetch_add((int*)arg, 1, __ATOMIC_RELAXED);
+}
+
+static void* unref_thread(void* arg) {
+    defer_ref_t* ref = (defer_ref_t*)arg;
+    // Inherits one reference taken by the owner, drops it on return
+    defer_unref(ref);
+    for (int i = 0; i < 1000; i++) {
+        defer_ref_acquire(ref);
+        defer_unref(ref);
+    }
+    return NULL;
+}
+
+typedef struct {
+    defer_ref_t* ref;
+    int* destroyed;
+    int step;
+    int ok;
+} unref_handoff_t;
+
+static void wait_step(unref_handoff_t* handoff, int step) {
+    while (__atomic_load_n(&handoff->step, __ATOMIC_ACQUIRE) != step) {
+        usleep(100);
+    }
+}
+
+static void* unref_buffer_thread(void* arg) {
+    unref_handoff_t* handoff = (unref_handoff_t*)arg;
+    defer_ref_acquire(handoff->ref);
+    {
+        defer_unref(handoff->ref);  // Buffered in this thread
+    }
+    __atomic_store_n(&handoff->step, 1, __ATOMIC_RELEASE);
+    wait_step(handoff, 2);
+
+    // The owner has dropped its reference; ours is still buffered
+    int early = __atomic_load_n(handoff->destroyed, __ATOMIC_ACQUIRE);
+    defer_unref_flush();
+    handoff->ok = early == 0 && __atomic_load_n(handoff->destroyed, __ATOMIC_ACQUIRE) == 1;
+    return NULL;
+}
+
+#define UNREF_RACE_ROUNDS 20000
+
+typedef struct {
+    defer_ref_t ref;
+    int destroyed;
+} unref_race_obj_t;
+
+typedef struct {
+    unref_race_obj_t* objs;
+    int round;      // Objects below this index are ready to release
+    int released;   // Non-owner releases applied so far
+} unref_race_t;
+
+static void count_race_destroy(void* arg) {
+    __atomic_fetch_add((int*)arg, 1, __ATOMIC_RELAXED);
+}
+
+// Releases one owner-acquired reference per round, racing the owner's drain
+static void* unref_race_thread(void* arg) {
+    unref_race_t* race = (unref_race_t*)arg;
+    for (int r = 0; r < UNREF_RACE_ROUNDS; r++) {
+        while (__atomic_load_n(&race->round, __ATOMIC_ACQUIRE) <= r) {
+            sched_yield();
+        }
+        defer_ref_release(&race->objs[r].ref);
+        defer_unref_flush();
+        __atomic_fetch_add(&race->released, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+void test_biased_unref(void) {
+    printf("\n=== Testing Biased Reference Counting ===\n");
+
+    int destroyed = 0;
+    defer_ref_t ref;
+    defer_ref_init(&ref, count_destroy, &destroyed);
+
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        defer_ref_acquire(&ref);
+        if (pthread_create(&threads[i], NULL, unref_thread, &ref) != 0) {
+            print_error("Failed to create thread");
+            return;
+        }
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (destroyed != 0) {
+        print_error("Object destroyed while the owner still held it");
+        return;
+    }
+    defer_ref_release(&ref);
+    if (destroyed != 1) {
+        print_error("Destructor did not run once after the last release");
+        return;
+    }
+
+    // A non-owner release stays buffered until its thread flushes
+    destroyed = 0;
+    defer_ref_t other;
+    defer_ref_init(&other, count_destroy, &destroyed);
+    unref_handoff_t handoff = { &other, &destroyed, 0, 0 };
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, unref_buffer_thread, &handoff) != 0) {
+        print_error("Failed to create thread");
+        return;
+    }
+    wait_step(&handoff, 1);
+    defer_ref_release(&other);
+    __atomic_store_n(&handoff.step, 2, __ATOMIC_RELEASE);
+    pthread_join(thread, NULL);
+    if (!handoff.ok) {
+        print_error("Buffered release was not merged by defer_unref_flush");
+        return;
+    }
+
+    // Non-owner releases race the owner's final release and merge: every
+    // object must be destroyed exactly once
+    unref_race_t race = { calloc(UNREF_RACE_ROUNDS, sizeof(unref_race_obj_t)), 0, 0 };
+    if (!race.objs) {
+        print_error("Failed to allocate race objects");
+        return;
+    }
+    defer_free(race.objs);
+    pthread_t racers[2];
+    for (int i = 0; i < 2; i++) {
+        if (pthread_create(&racers[i], NULL, unref_race_thread, &race) != 0) {
+            print_error("Failed to create thread");
+            return;
+        }
+    }
+    for (int r = 0; r < UNREF_RACE_ROUNDS; r++) {
+        unref_race_obj_t* obj = &race.objs[r];
+        defer_ref_init(&obj->ref, count_race_destroy, &obj->destroyed);
+        defer_ref_acquire(&obj->ref);
+        defer_ref_acquire(&obj->ref);
+        __atomic_store_n(&race.round, r + 1, __ATOMIC_RELEASE);
+        defer_ref_release(&obj->ref);
+    }
+    for (int i = 0; i < 2; i++) {
+        pthread_join(racers[i], NULL);
+    }
+    defer_unref_flush();  // Merges whatever the racers queued last
+    for (int r = 0; r < UNREF_RACE_ROUNDS; r++) {
+        if (__atomic_load_n(&race.objs[r].destroyed, __ATOMIC_ACQUIRE) != 1) {
+            printf("Object %d destroyed %d times\n", r, race.objs[r].destroyed);
+            print_error("Racing releases leaked or double-destroyed an object");
+            return;
+        }
+    }
+    print_success("Biased reference counting test completed");
+}
+
+static void count_tick(void* arg) {
+    (*(long*)arg)++;
+}
+
+static void requeue_tick(void* arg) {
+    // Queued while draining: must wait for the next tick
+    defer_to_tick(count_tick, arg);
+}
+
+typedef struct {
+    defer_tick_t* tick;
+    long* counter;
+    int failed;
+} tick_producer_t;
+
+static void* tick_producer(void* arg) {
+    tick_producer_t* producer = (tick_producer_t*)arg;
+    for (int i = 0; i < 5000; i++) {
+        while (defer_to_tick_in(producer->tick, count_tick, producer->counter) != 0) {
+            if (errno != EAGAIN) {
+                producer->failed = 1;
+                return NULL;
+            }
+            usleep(50);  // Inbox full until the loop drains
+        }
+    }
+    return NULL;
+}
+
+void test_tick_queue(void) {
+    printf("\n=== Testing Tick Queue ===\n");
+
+    defer_tick_t* tick = malloc(sizeof(defer_tick_t));
+    if (!tick) {
+        print_error("Failed to allocate tick queue");
+        return;
+    }
+    defer_free(tick);
+    defer_tick_init(tick);
+    defer_tick(tick);
+
+    long counter = 0;
+    defer_to_tick(count_tick, &counter);
+    defer_to_tick(requeue_tick, &counter);
+    if (counter != 0 || defer_tick_run() != 2 || counter != 1) {
+        print_error("Tick callbacks did not run at the tick");
+        return;
+    }
+    if (defer_tick_run() != 1 || counter != 2) {
+        print_error("Callback queued during a tick did not wait for the next one");
+        return;
+    }
+
+    for (int i = 0; i < DEFER_TICK_SIZE; i++) {
+        defer_to_tick(count_tick, &counter);
+    }
+    if (defer_to_tick(count_tick, &counter) != -1 || errno != EAGAIN) {
+        print_error("Full tick ring was not reported");
+        return;
+    }
+    defer_tick_run();
+
+    // Producers on other threads go through the inbox
+    long remote = 0;
+    tick_producer_t producers[4];
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        producers[i] = (tick_producer_t){ tick, &remote, 0 };
+        pthread_create(&threads[i], NULL, tick_producer, &producers[i]);
+    }
+    while (remote < 4 * 5000) {
+        if (defer_tick_run() == 0) {
+            usleep(50);
+        }
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        if (producers[i].failed) {
+            print_error("Cross-thread defer_to_tick_in failed");
+            return;
+        }
+    }
+    if (defer_tick_run() != 0 || remote != 4 * 5000) {
+        print_error("Inbox delivered the wrong number of callbacks");
+        return;
+    }
+
+    {
+        defer_tick_t* scoped = malloc(sizeof(defer_tick_t));
+        if (!scoped) {
+            print_error("Failed to allocate tick queue");
+            return;
+        }
+        defer_free(scoped);
+        defer_tick_init(scoped);
+        defer_tick(scoped);
+        defer_to_tick(count_tick, &counter);
+        counter = 0;
+    }
+    if (counter != 1) {
+        print_error("Scope exit did not drain the tick queue");
+        return;
+    }
+    // The outer tick is current again once the nested one exits
+    counter = 0;
+    if (defer_to_tick(count_tick, &counter) != 0 || defer_tick_run_in(tick) != 1 || counter != 1) {
+        print_error("Nested tick scope did not restore the outer tick");
+        return;
+    }
+    print_success("Tick queue test completed");
+}
+
+// Mock connection factory for the handle pool
+typedef struct {
+    int id;
+    int healthy;
+} mock_conn_t;
+
+typedef struct {
+    int created;
+    int destroyed;
+} mock_factory_t;
+
+static void* mock_connect(void* ctx) {
+    mock_factory_t* factory = (mock_factory_t*)ctx;
+    mock_conn_t* conn = malloc(sizeof(mock_conn_t));
+    if (conn) {
+        conn->id = __atomic_add_fetch(&factory->created, 1, __ATOMIC_RELAXED);
+        conn->healthy = 1;
+    }
+    return conn;
+}
+
+static void mock_disconnect(void* handle, void* ctx) {
+    __atomic_fetch_add(&((mock_factory_t*)ctx)->destroyed, 1, __ATOMIC_RELAXED);
+    free(handle);
+}
+
+static int mock_ping(void* handle, void* ctx) {
+    (void)ctx;
+    return ((mock_conn_t*)handle)->healthy ? 0 : -1;
+}
+
+static long elapsed_ms(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long)(now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static void* pool_holder(void* arg) {
+    defer_pool_t* pool = (defer_pool_t*)arg;
+    mock_conn_t* conn;
+    defer_checkout(pool, &conn, -1);
+    usleep(20000);  // Returned at scope exit to the waiting main thread
+    return NULL;
+}
+
+// Checks out one handle and returns it to this thread's affinity slot
+static void* pool_visitor(void* arg) {
+    defer_pool_t* pool = (defer_pool_t*)arg;
+    mock_conn_t* conn;
+    defer_checkout(pool, &conn, 0);
+    return NULL;
+}
+
+void test_handle_pool(void) {
+    printf("\n=== Testing Handle Pool ===\n");
+
+    mock_factory_t factory = { 0, 0 };
+    defer_pool_config_t config = { mock_connect, mock_disconnect, mock_ping, &factory, 2, 0 };
+    defer_pool_t pool;
+    if (defer_pool_init(&pool, &config) != 0) {
+        print_error("Failed to initialize pool");
+        return;
+    }
+
+    int first_id = 0;
+    {
+        mock_conn_t* conn;
+        defer_checkout(&pool, &conn, 0);
+        if (!conn) {
+            print_error("Checkout failed");
+            defer_pool_destroy(&pool);
+            return;
+        }
+        first_id = conn->id;
+    }
+    {
+        mock_conn_t* conn;
+        defer_checkout(&pool, &conn, 0);
+        if (!conn || conn->id != first_id || factory.created != 1) {
+            print_error("Returned handle was not reused");
+            defer_pool_destroy(&pool);
+            return;
+        }
+        conn->healthy = 0;  // Fails the health check on the next checkout
+    }
+
+    {
+        mock_conn_t* a;
+        defer_checkout(&pool, &a, 0);
+        mock_conn_t* b;
+        defer_checkout(&pool, &b, 0);
+        if (!a || !b || a->id == first_id || factory.destroyed != 1) {
+            print_error("Unhealthy handle was not replaced");
+            defer_pool_destroy(&pool);
+            return;
+        }
+
+        // Exhausted: a bounded wait times out
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        mock_conn_t* c;
+        defer_checkout(&pool, &c, 50);
+        if (c || errno != ETIMEDOUT || elapsed_ms(&start) < 40) {
+            print_error("Exhausted pool did not time out");
+            defer_pool_destroy(&pool);
+            return;
+        }
+    }
+
+    // A waiter is woken by a release from another thread
+    {
+        mock_conn_t* a;
+        defer_checkout(&pool, &a, 0);
+        pthread_t thread;
+        pthread_create(&thread, NULL, pool_holder, &pool);
+        usleep(5000);
+        mock_conn_t* b;
+        defer_checkout(&pool, &b, 2000);
+        pthread_join(thread, NULL);
+        if (!a || !b || factory.created != 3) {
+            print_error("Waiter did not get the released handle");
+            defer_pool_destroy(&pool);
+            return;
+        }
+    }
+    defer_pool_destroy(&pool);
+    if (factory.destroyed != factory.created) {
+        print_error("Pool leaked handles");
+        return;
+    }
+
+    // Idle handles past the timeout are evicted, including the one in the affinity slot
+    factory = (mock_factory_t){ 0, 0 };
+    config = (defer_pool_config_t){ mock_connect, mock_disconnect, NULL, &factory, 4, 10 };
+    if (defer_pool_init(&pool, &config) != 0) {
+        print_error("Failed to initialize pool");
+        return;
+    }
+    void* handles[3];
+    for (int i = 0; i < 3; i++) {
+        handles[i] = defer_pool_acquire(&pool, 0);
+    }
+    for (int i = 0; i < 3; i++) {
+        defer_pool_release(&pool, handles[i]);
+    }
+    usleep(20000);
+    int evicted = defer_pool_evict(&pool);
+    defer_pool_destroy(&pool);
+    if (evicted != 3 || factory.destroyed != 3) {
+        print_error("Idle handles were not evicted");
+        return;
+    }
+
+    // Every thread parks its handle in a slot of its own
+    factory = (mock_factory_t){ 0, 0 };
+    config = (defer_pool_config_t){ mock_connect, mock_disconnect, NULL, &factory, 4, 0 };
+    if (defer_pool_init(&pool, &config) != 0) {
+        print_error("Failed to initialize pool");
+        return;
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, pool_visitor, &pool);
+        pthread_join(thread, NULL);
+    }
+    int parked = 0;
+    for (int i = 0; i < DEFER_POOL_AFFINITY; i++) {
+        parked += pool.affinity[i] != NULL;
+    }
+    defer_pool_destroy(&pool);
+    if (parked != 4 || factory.created != 4) {
+        print_error("Threads shared an affinity slot");
+        return;
+    }
+    print_success("Handle pool test completed");
+}
+
+typedef struct {
+    defer_handle_t handles[256];
+    int released;
+} handle_racer_t;
+
+static void* handle_racer(void* arg) {
+    handle_racer_t* racer = (handle_racer_t*)arg;
+    for (int round = 0; round < 200; round++) {
+        for (int i = 0; i < 256; i++) {
+            if (defer_handle_release(racer->handles[i]) == 0) {
+                racer->released++;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void sum_handle(defer_handle_t handle, void* object, void* ctx) {
+    (void)handle;
+    *(long*)ctx += *(int*)object;
+}
+
+void test_handle_table(void) {
+    printf("\n=== Testing Generational Handles ===\n");
+
+    int value = 7;
+    defer_handle_t handle = defer_handle_alloc(&value, count_destroy);
+    if (handle == 0 || defer_handle_get(handle) != &value) {
+        print_error("Handle lookup failed");
+        return;
+    }
+    int released = 0;
+    defer_handle_t stale = handle;
+    {
+        defer_handle(&stale);  // Released at scope exit, after scoped
+        defer_handle_t scoped = defer_handle_alloc(&released, count_destroy);
+        defer_handle(&scoped);
+    }
+    if (defer_handle_get(handle) != NULL || released != 1 || value != 8) {
+        print_error("Scoped handles were not released");
+        return;
+    }
+    if (defer_handle_release(handle) != -1 || value != 8) {
+        print_error("Releasing a stale handle was not a no-op");
+        return;
+    }
+
+    // The slot is recycled under a new generation; the old handle stays dead
+    defer_handle_t reused = defer_handle_alloc(&value, count_destroy);
+    if ((uint32_t)reused != (uint32_t)handle || reused == handle || defer_handle_get(handle) != NULL) {
+        print_error("Recycled slot did not get a new generation");
+        return;
+    }
+    long sum = 0;
+    if (defer_handle_each(sum_handle, &sum) != 1 || sum != 8) {
+        print_error("Live handle iteration was wrong");
+        return;
+    }
+    defer_handle_release(reused);
+
+    // Threads race to release the same handles: each destructor runs once
+    int counters[256] = {0};
+    handle_racer_t racers[4];
+    for (int i = 0; i < 256; i++) {
+        racers[0].handles[i] = defer_handle_alloc(&counters[i], count_destroy);
+    }
+    pthread_t threads[4];
+    for (int t = 0; t < 4; t++) {
+        memcpy(racers[t].handles, racers[0].handles, sizeof(racers[0].handles));
+        racers[t].released = 0;
+        pthread_create(&threads[t], NULL, handle_racer, &racers[t]);
+    }
+    int total = 0;
+    for (int t = 0; t < 4; t++) {
+        pthread_join(threads[t], NULL);
+        total += racers[t].released;
+    }
+    for (int i = 0; i < 256; i++) {
+        if (counters[i] != 1) {
+            print_error("Handle destructor ran more than once");
+            return;
+        }
+    }
+    if (total != 256) {
+        print_error("Racing releases were miscounted");
+        return;
+    }
+    print_success("Generational handle test completed");
+}
+
+#if defined(__linux__) && defined(CPU_SETSIZE)
+static int current_policy(void) {
+    int policy;
+    struct sched_param param;
+    return pthread_getschedparam(pthread_self(), &policy, &param) == 0 ? policy : -1;
+}
+
+static int pin_nested(int outer, int inner, int* inside_cpu) {
+    defer_pin_cpu(outer);
+    {
+        int status = -1;
+        defer_pin_cpu_status(inner, &status);
+        if (status != 0) {
+            return -1;
+        }
+        *inside_cpu = sched_getcpu();
+    }
+    return sched_getcpu() == outer ? 0 : -1;
+}
+#endif
+
+void test_cpu_scopes(void) {
+    printf("\n=== Testing defer_pin_cpu/defer_sched ===\n");
+#if defined(__linux__) && defined(CPU_SETSIZE)
+    cpu_set_t before, after;
+    if (sched_getaffinity(0, sizeof(before), &before) != 0) {
+        print_error("sched_getaffinity failed");
+        return;
+    }
+    int first = -1, last = -1;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &before)) {
+            first = first < 0 ? cpu : first;
+            last = cpu;
+        }
+    }
+
+    // Nested pins restore the outer pin, then the original mask
+    int inside_cpu = -1;
+    if (pin_nested(last, first, &inside_cpu) != 0 || inside_cpu != first) {
+        print_error("Nested defer_pin_cpu did not pin or restore the outer CPU");
+        return;
+    }
+    if (sched_getaffinity(0, sizeof(after), &after) != 0 || !CPU_EQUAL(&before, &after)) {
+        print_error("Affinity mask was not restored");
+        return;
+    }
+
+    // A scope that fails to apply reports the error and restores nothing
+    {
+        int status = 0;
+        defer_pin_cpu_status(DEFER_MAX_CPUS, &status);
+        if (status != EINVAL) {
+            print_error("Invalid CPU was not rejected");
+            return;
+        }
+    }
+    sched_getaffinity(0, sizeof(after), &after);
+    if (!CPU_EQUAL(&before, &after)) {
+        print_error("Failed pin changed the affinity mask");
+        return;
+    }
+
+    // SCHED_BATCH needs no privileges; SCHED_FIFO may be refused
+    int policy = current_policy();
+    {
+        int status = -1;
+        defer_sched_status(SCHED_BATCH, 0, &status);
+        if (status != 0 || current_policy() != SCHED_BATCH) {
+            print_error("defer_sched did not apply SCHED_BATCH");
+            return;
+        }
+        {
+            int fifo = -1;
+            defer_sched_status(SCHED_FIFO, 1, &fifo);
+            if ((fifo == 0) != (current_policy() == SCHED_FIFO)) {
+                print_error("defer_sched status does not match the policy");
+                return;
+            }
+        }
+        if (current_policy() != SCHED_BATCH) {
+            print_error("Inner defer_sched did not restore SCHED_BATCH");
+            return;
+        }
+    }
+    if (current_policy() != policy) {
+        print_error("Scheduling policy was not restored");
+        return;
+    }
+
+    // Nested mlockall sections unlock once the outermost exits
+    {
+        int status = -1;
+        defer_mlockall_status(MCL_CURRENT, &status);
+        if (status != 0 && status != EPERM && status != ENOMEM) {
+            print_error("defer_mlockall failed unexpectedly");
+            return;
+        }
+        defer_mlockall(MCL_CURRENT);
+        // An inner section cannot change the flags of the outer one
+        int inner = -1;
+        defer_mlockall_status(MCL_CURRENT | MCL_FUTURE, &inner);
+        if (status == 0 && inner != EBUSY) {
+            print_error("Nested defer_mlockall with other flags was not refused");
+            return;
+        }
+    }
+    print_success("CPU pinning, scheduling and mlockall scopes restore their state");
+#else
+    printf("CPU scope test skipped (Linux with _GNU_SOURCE only)\n");
+#endif
+}
+
+// Locked KB from /proc/self/status, or -1 where it is not available
+static long locked_kb(void) {
+    FILE* status = fopen("/proc/self/status", "r");
+    if (!status) {
+        return -1;
+    }
+    defer_fclose(status);
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), status)) {
+        if (sscanf(line, "VmLck: %ld kB", &kb) == 1) {
+            break;
+        }
+    }
+    return kb;
+}
+
+void test_mlock_scope(void) {
+    printf("\n=== Testing defer_mlock ===\n");
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    defer_alloc_t buffer;
+    char* buf = defer_alloc_aligned(&buffer, page, 4 * page);
+    if (!buf) {
+        print_error("Failed to allocate the buffer");
+        return;
+    }
+    size_t base = defer_mlock_locked();
+    long base_kb = locked_kb();
+    {
+        int status = -1;
+        defer_mlock_status(buf, 3 * page, &status);
+        if (status == EPERM) {
+            printf("defer_mlock test skipped (mlock not permitted)\n");
+            return;
+        }
+        if (status != 0 || defer_mlock_locked() != base + 3 * page) {
+            print_error("defer_mlock did not lock the range");
+            return;
+        }
+        {
+            // Overlaps pages 1-2 and adds page 3; unaligned bounds round out
+            defer_mlock(buf + page + 1, 3 * page - 1);
+            if (defer_mlock_locked() != base + 4 * page) {
+                print_error("Overlapping defer_mlock was charged twice");
+                return;
+            }
+        }
+        if (defer_mlock_locked() != base + 3 * page ||
+            (base_kb >= 0 && locked_kb() != base_kb + (long)(3 * page / 1024))) {
+            print_error("Inner scope unlocked pages the outer scope holds");
+            return;
+        }
+    }
+    if (defer_mlock_locked() != base || (base_kb >= 0 && locked_kb() != base_kb)) {
+        print_error("Pages stayed locked after the last scope exited");
+        return;
+    }
+
+    // New pages over RLIMIT_MEMLOCK are refused before locking anything
+    struct rlimit saved;
+    getrlimit(RLIMIT_MEMLOCK, &saved);
+    struct rlimit tight = saved;
+    tight.rlim_cur = base + page;
+    if (setrlimit(RLIMIT_MEMLOCK, &tight) == 0) {
+        int status = -1;
+        {
+            defer_mlock_status(buf, 2 * page, &status);
+        }
+        setrlimit(RLIMIT_MEMLOCK, &saved);
+        if (status != ENOMEM || defer_mlock_locked() != base) {
+            print_error("defer_mlock exceeded the RLIMIT_MEMLOCK budget");
+            return;
+        }
+    }
+
+    // Pages locked outside defer_mlock count against the budget too
+    if (base_kb >= 0 && mlock(buf + 3 * page, page) == 0) {
+        tight.rlim_cur = (rlim_t)locked_kb() * 1024 + page;
+        int status = -1;
+        if (setrlimit(RLIMIT_MEMLOCK, &tight) == 0) {
+            {
+                defer_mlock_status(buf, 2 * page, &status);
+            }
+            setrlimit(RLIMIT_MEMLOCK, &saved);
+        }
+        munlock(buf + 3 * page, page);
+        if (status != -1 && status != ENOMEM) {
+            print_error("defer_mlock ignored pages locked elsewhere");
+            return;
+        }
+    }
+
+    // Leaving a defer_mlockall section keeps the ranges still held locked
+    {
+        defer_mlock(buf, page);
+        {
+            int status = -1;
+            defer_mlockall_status(MCL_CURRENT, &status);
+        }
+        if (base_kb >= 0 && locked_kb() < base_kb + (long)(page / 1024)) {
+            print_error("Range was unlocked when a defer_mlockall section ended");
+            return;
+        }
+    }
+
+    // Pages the caller locked itself stay locked after a defer_mlockall section
+    if (mlock(buf + 3 * page, page) == 0) {
+        long held_kb = locked_kb();
+        {
+            int status = -1;
+            defer_mlockall_status(MCL_CURRENT, &status);
+        }
+        long after_kb = locked_kb();
+        munlockall();  // The section left the whole process locked; no scope holds a range here
+        if (held_kb >= 0 && after_kb < held_kb) {
+            print_error("defer_mlockall dropped a lock taken before the section");
+            return;
+        }
+    }
+    print_success("defer_mlock reference counts overlapping ranges");
+}
+
+// Child side of test_shm_ring: checks every message and exits with 0
+static int consume_messages(const char* name, int count) {
+    defer_shm_t shm;
+    if (defer_shm_open(&shm, name) != 0) {
+        return 1;
+    }
+    defer_shm(&shm);
+    defer_ring_t* ring = defer_ring_attach(shm.addr);
+    if (!ring) {
+        return 2;
+    }
+    for (int i = 0; i < count; i++) {
+        const void* data;
+        size_t len;
+        while ((data = defer_ring_peek(ring, &len)) == NULL) {
+            sched_yield();
+        }
+        const unsigned char* bytes = (const unsigned char*)data;
+        if (len != (size_t)(i % 200) || (len > 0 && (bytes[0] != (unsigned char)i || bytes[len - 1] != (unsigned char)i))) {
+            return 3;
+        }
+        defer_ring_release(ring);
+    }
+    return 0;
+}
+
+void test_shm_ring(void) {
+    printf("\n=== Testing defer_shm and the SPSC ring ===\n");
+    char name[64];
+    snprintf(name, sizeof(name), "/defer_test_%ld", (long)getpid());
+    const int count = 20000;  // Wraps the 4 KiB ring many times
+    {
+        defer_shm_t shm;
+        if (defer_shm_create(&shm, name, defer_ring_bytes(4096)) != 0) {
+            print_error("defer_shm_create failed");
+            return;
+        }
+        defer_shm(&shm);
+        defer_shm_t again;
+        if (defer_shm_create(&again, name, 4096) == 0 || errno != EEXIST) {
+            print_error("Creating an existing segment did not fail");
+            return;
+        }
+        defer_ring_t* ring = defer_ring_init(shm.addr, shm.size);
+        if (!ring || ring->capacity != 4096 || defer_ring_reserve(ring, 4096) != NULL || errno != EMSGSIZE) {
+            print_error("Ring was not formatted as expected");
+            return;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            _exit(consume_messages(name, count));
+        }
+        for (int i = 0; i < count; i++) {
+            size_t len = (size_t)(i % 200);
+            unsigned char* slot;
+            while ((slot = (unsigned char*)defer_ring_reserve(ring, len)) == NULL) {
+                sched_yield();
+            }
+            memset(slot, i, len);
+            defer_ring_commit(ring);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            print_error("Consumer saw a wrong message");
+            return;
+        }
+        if (defer_ring_peek(ring, &(size_t){0}) != NULL || errno != EAGAIN) {
+            print_error("Ring not empty after the consumer finished");
+            return;
+        }
+    }
+
+    // The owner unlinked the name at scope exit
+    defer_shm_t gone;
+    if (defer_shm_open(&gone, name) == 0 || errno != ENOENT) {
+        print_error("Owner did not unlink the segment");
+        return;
+    }
+
+    // Anonymous segments are shared with forked children
+    defer_shm_t anon;
+    if (defer_shm_create(&anon, NULL, 4096) != 0) {
+        print_error("Anonymous defer_shm_create failed");
+        return;
+    }
+    defer_shm(&anon);
+    pid_t pid = fork();
+    if (pid == 0) {
+        *(volatile int*)anon.addr = 42;
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+    if (*(volatile int*)anon.addr != 42) {
+        print_error("Anonymous segment was not shared");
+        return;
+    }
+    print_success("Shared-memory segment and ring test completed");
+}
+
+#else
+
+void test_nursery_spawn(void) {
+    printf("Nursery spawn test skipped (POSIX only)\n");
+}
+
+void test_nursery_errors(void) {
+    printf("Nursery error collection test skipped (POSIX only)\n");
+}
+
+void test_thread_exit(void) {
+    printf("Thread-exit defer test skipped (POSIX only)\n");
+}
+
+void test_shutdown_mode(void) {
+    printf("Fast shutdown mode test skipped (POSIX only)\n");
+}
+
+void test_biased_unref(void) {
+    printf("Biased reference counting test skipped (POSIX only)\n");
+}
+
+void test_tick_queue(void) {
+    printf("Tick queue test skipped (POSIX only)\n");
+}
+
+void test_handle_pool(void) {
+    printf("Handle pool test skipped (POSIX only)\n");
+}
+
+void test_handle_table(void) {
+    printf("Generational handle test skipped (POSIX only)\n");
+}
+
+void test_cpu_scopes(void) {
+    printf("CPU scope test skipped (POSIX only)\n");
+}
+
+void test_mlock_scope(void) {
+    printf("defer_mlock test skipped (POSIX only)\n");
+}
+
+void test_shm_ring(void) {
+    printf("Shared-memory ring test skipped (POSIX only)\n");
+}
+
+#endif
@@ -51,6 +51,14 @@ int main(void) {
     test_multiple_defers();
     printf("\n");
 
+    test_compact_defer();
+    test_fp_scopes();
+    test_once_defer();
+    printf("\n");
+
+    test_try_throw();
+    printf("\n");
+
     // Run memory tests
     printf("\n=== Running Memory Tests ===\n");
     test_zero_allocation();
@@ -61,6 +69,8 @@ int main(void) {
     test_custom_cleanup();
     test_allocation_errors();
     test_nested_scope_allocation();
+    test_mem_scope();
+    test_alloc_helpers();
 
     // Run file tests
     printf("\n=== Running Resource Tests ===\n");
@@ -91,6 +101,29 @@ int main(void) {
     test_opengl_resources();
     printf("\n");
 
+    // I/O helper tests
+    printf("\n=== Running I/O Tests ===\n");
+    test_streaming_reader();
+    test_direct_reader();
+    test_buffered_writer();
+    test_group_fsync();
+    test_sendfile_transfer();
+    test_tmpfile_tmpdir();
+
+    // Concurrency helper tests
+    printf("\n=== Running Concurrency Tests ===\n");
+    test_nursery_spawn();
+    test_nursery_errors();
+    test_thread_exit();
+    test_shutdown_mode();
+    test_biased_unref();
+    test_tick_queue();
+    test_handle_pool();
+    test_handle_table();
+    test_cpu_scopes();
+    test_mlock_scope();
+    test_shm_ring();
+
     printf("\nAll tests completed.\n");
     return 0;
 } 
\ No newline at end of file
@@ -0,0 +1,72 @@
+/**
+ * @file test_exceptions.c
+ * @brief C frames crossed by C++ exceptions, built with -fexceptions
+ *
+ * Driven by test_exceptions.cpp, which passes in callbacks that throw. Each
+ * frame holds a defer_free and a defer_fclose that must run while the
+ * exception unwinds through it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include "test_common.h"
+
+#define DEFER_IMPLEMENTATION
+#include "../defer.h"
+
+typedef void (*visit_fn)(int depth, void* ctx);
+
+static void count_cleanup(void* arg) {
+    (*(int*)arg)++;
+}
+
+// Opens a file and a buffer per level, then calls visit at the innermost one
+int descend_frames(int depth, visit_fn visit, void* ctx, int* cleanups) {
+    char* buffer = malloc(4096);
+    if (!buffer) {
+        return -1;
+    }
+    defer_free(buffer);
+
+    FILE* file = tmpfile();
+    if (!file) {
+        return -1;
+    }
+    defer_fclose(file);
+    defer(count_cleanup, cleanups);
+
+    fprintf(file, "level %d\n", depth);
+    if (depth == 0) {
+        visit(depth, ctx);
+        return 0;
+    }
+    return descend_frames(depth - 1, visit, ctx, cleanups);
+}
+
+// Number of open descriptors, from /proc/self/fd; -1 where unavailable
+int count_open_fds(void) {
+    DIR* dir = opendir("/proc/self/fd");
+    if (!dir) {
+        return -1;
+    }
+    int count = 0;
+    while (readdir(dir)) {
+        count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+// Bytes currently allocated from the heap; -1 where unavailable
+long heap_in_use(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return (long)mallinfo2().uordblks;
+#else
+    return -1;
+#endif
+}
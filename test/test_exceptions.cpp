@@ -0,0 +1,80 @@
+/**
+ * @file test_exceptions.cpp
+ * @brief C++ exceptions thrown through C frames that hold defers
+ *
+ * The C side (test_exceptions.c) is compiled with -fexceptions, so the
+ * cleanup attribute runs its defers while an exception unwinds through it.
+ */
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include "test_common.h"
+
+typedef void (*visit_fn)(int depth, void* ctx);
+
+extern "C" {
+int descend_frames(int depth, visit_fn visit, void* ctx, int* cleanups);
+int count_open_fds(void);
+long heap_in_use(void);
+}
+
+static void throw_error(int depth, void* ctx) {
+    throw std::runtime_error(static_cast<const char*>(ctx) + std::to_string(depth));
+}
+
+static void no_throw(int, void* ctx) {
+    ++*static_cast<int*>(ctx);
+}
+
+static void test_no_throw_path() {
+    printf("\n=== Testing defers on the non-throwing path ===\n");
+    int visits = 0, cleanups = 0;
+    if (descend_frames(3, no_throw, &visits, &cleanups) != 0 || visits != 1 || cleanups != 4) {
+        print_error("Defers did not run on the non-throwing path");
+        return;
+    }
+    print_success("Defers run normally in C built with -fexceptions");
+}
+
+static void test_throw_through_c() {
+    printf("\n=== Testing C++ exceptions through C defers ===\n");
+    int cleanups = 0;
+    std::string message;
+    try {
+        descend_frames(3, throw_error, const_cast<char*>("depth "), &cleanups);
+    } catch (const std::runtime_error& e) {
+        message = e.what();
+    }
+    if (message != "depth 0") {
+        print_error("Exception did not propagate through the C frames");
+        return;
+    }
+    if (cleanups != 4) {
+        print_error("Defers did not run while unwinding");
+        return;
+    }
+
+    // Repeated throws must not leak the buffers or the files
+    int fds = count_open_fds();
+    long heap = heap_in_use();
+    for (int i = 0; i < 8; i++) {
+        try {
+            descend_frames(3, throw_error, const_cast<char*>(""), &cleanups);
+        } catch (const std::runtime_error&) {
+        }
+    }
+    if (cleanups != 36 || count_open_fds() != fds || heap_in_use() != heap) {
+        print_error("defer_free/defer_fclose leaked during unwinding");
+        return;
+    }
+    print_success("defer_free and defer_fclose run when a C++ exception unwinds C frames");
+}
+
+int main() {
+    printf("Starting defer.h exception tests...\n");
+    test_no_throw_path();
+    test_throw_through_c();
+    printf("\nAll exception tests completed.\n");
+    return 0;
+}
@@ -0,0 +1,485 @@
+/**
+ * @file test_io.c
+ * @brief File descriptor and I/O helper tests for defer.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_common.h"
+#include "../defer.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+
+// Write `size` bytes of a repeating pattern to `path`
+static int write_pattern_file(const char* path, size_t size) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return -1;
+    }
+    defer_fclose(file);
+
+    for (size_t i = 0; i < size; i++) {
+        if (fputc((int)(i % 251), file) == EOF) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void remove_file(void* path) {
+    remove((const char*)path);
+}
+
+void test_streaming_reader(void) {
+    printf("\n=== Testing Streaming Reader ===\n");
+
+    char path[256];
+    snprintf(path, sizeof(path), "build%creader.bin", PATH_SEP);
+    size_t size = 3 * 4096 + 123;
+    if (write_pattern_file(path, size) != 0) {
+        print_error("Failed to create reader input file");
+        return;
+    }
+    defer(remove_file, path);
+
+    defer_reader_t reader;
+    if (defer_reader_open(&reader, path, 4096, DEFER_READER_DIRECT) != 0) {
+        print_error("Failed to open streaming reader");
+        return;
+    }
+    defer_reader(&reader);
+
+    const void* chunk;
+    const void* previous = NULL;
+    ssize_t n;
+    size_t total = 0;
+    while ((n = defer_reader_next(&reader, &chunk)) > 0) {
+        const unsigned char* bytes = (const unsigned char*)chunk;
+        for (ssize_t i = 0; i < n; i++) {
+            if (bytes[i] != (unsigned char)((total + (size_t)i) % 251)) {
+                print_error("Streaming reader returned wrong data");
+                return;
+            }
+        }
+        if (previous && previous == chunk) {
+            print_error("Streaming reader reused the previous chunk buffer");
+            return;
+        }
+        previous = chunk;
+        total += (size_t)n;
+    }
+
+    if (n < 0 || total != size) {
+        print_error("Streaming reader did not read the whole file");
+        return;
+    }
+    print_success("Streaming reader test completed");
+}
+
+// Chunk sizes that end mid-block leave the next read continuing a partial block
+void test_direct_reader(void) {
+    printf("\n=== Testing Streaming Reader with O_DIRECT ===\n");
+
+    char path[256];
+    snprintf(path, sizeof(path), "build%cdirect.bin", PATH_SEP);
+    size_t size = 5 * DEFER_READER_ALIGN + 321;
+    if (write_pattern_file(path, size) != 0) {
+        print_error("Failed to create O_DIRECT input file");
+        return;
+    }
+    defer(remove_file, path);
+
+    defer_reader_t reader;
+    if (defer_reader_open(&reader, path, 2 * DEFER_READER_ALIGN, DEFER_READER_DIRECT) != 0) {
+        print_error("Failed to open O_DIRECT reader");
+        return;
+    }
+    defer_reader(&reader);
+    if (!(reader.flags & DEFER_READER_DIRECT)) {
+        printf("O_DIRECT reader test skipped (filesystem rejects O_DIRECT)\n");
+        return;
+    }
+
+    const void* chunk;
+    ssize_t n;
+    size_t total = 0;
+    while ((n = defer_reader_next(&reader, &chunk)) > 0) {
+        if ((uintptr_t)chunk % DEFER_READER_ALIGN != 0) {
+            print_error("O_DIRECT chunk buffer is not aligned");
+            return;
+        }
+        const unsigned char* bytes = (const unsigned char*)chunk;
+        for (ssize_t i = 0; i < n; i++) {
+            if (bytes[i] != (unsigned char)((total + (size_t)i) % 251)) {
+                print_error("O_DIRECT reader returned wrong data");
+                return;
+            }
+        }
+        total += (size_t)n;
+    }
+    if (n < 0 || total != size) {
+        print_error("O_DIRECT reader did not read the whole file");
+        return;
+    }
+    print_success("O_DIRECT reader reads aligned blocks to the end of the file");
+}
+
+static void close_fd(void* arg) {
+    close(*(int*)arg);
+}
+
+static void restore_fsync_window(void* arg) {
+    defer_fsync_config(*(long*)arg, 0);
+}
+
+void test_buffered_writer(void) {
+    printf("\n=== Testing Buffered Writer ===\n");
+
+    char path[256];
+    snprintf(path, sizeof(path), "build%cwriter.txt", PATH_SEP);
+    defer(remove_file, path);
+
+    char big[100];
+    memset(big, 'B', sizeof(big));
+    int status = -1;
+    {
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            print_error("Failed to open writer output file");
+            return;
+        }
+        defer_writer_t writer;
+        if (defer_writer_open(&writer, fd, 16, DEFER_WRITER_CLOSE) != 0) {
+            close(fd);
+            print_error("Failed to open buffered writer");
+            return;
+        }
+        writer.status = &status;
+        defer_writer(&writer);
+
+        defer_writer_write(&writer, "head:", 5);
+        struct iovec iov[2] = { { big, sizeof(big) }, { (void*)":tail", 5 } };
+        defer_writer_writev(&writer, iov, 2);
+        defer_writer_write(&writer, "\n", 1);
+    }
+
+    if (status != 0) {
+        print_error("Buffered writer reported an error");
+        return;
+    }
+
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        print_error("Failed to reopen writer output file");
+        return;
+    }
+    defer_fclose(file);
+
+    char expected[128], actual[128] = {0};
+    snprintf(expected, sizeof(expected), "head:%.*s:tail\n", (int)sizeof(big), big);
+    if (!fgets(actual, sizeof(actual), file) || strcmp(actual, expected) != 0) {
+        print_error("Buffered writer produced wrong output");
+        return;
+    }
+
+    // Errors at scope exit are reported rather than dropped
+    status = 0;
+    {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            print_error("Failed to open read-only fd");
+            return;
+        }
+        defer(close_fd, &fd);
+
+        defer_writer_t writer;
+        if (defer_writer_open(&writer, fd, 0, 0) != 0) {
+            print_error("Failed to open buffered writer");
+            return;
+        }
+        writer.status = &status;
+        defer_writer(&writer);
+        defer_writer_write(&writer, "lost", 4);
+    }
+    if (status != EBADF) {
+        print_error("Buffered writer did not report the flush failure");
+        return;
+    }
+    print_success("Buffered writer test completed");
+}
+
+typedef struct {
+    int fd;
+    int failures;
+} fsync_worker_t;
+
+static void* fsync_worker(void* arg) {
+    fsync_worker_t* worker = (fsync_worker_t*)arg;
+    for (int i = 0; i < 20; i++) {
+        if (write(worker->fd, "x", 1) != 1) {
+            worker->failures++;
+            continue;
+        }
+        int status = -1;
+        {
+            defer_fsync_status(worker->fd, &status);
+        }
+        if (status != 0) {
+            worker->failures++;
+        }
+    }
+    return NULL;
+}
+
+void test_group_fsync(void) {
+    printf("\n=== Testing Group Commit fsync ===\n");
+
+    char path[256];
+    snprintf(path, sizeof(path), "build%cfsync.txt", PATH_SEP);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        print_error("Failed to open fsync test file");
+        return;
+    }
+    defer(remove_file, path);
+    defer(close_fd, &fd);
+
+    long default_window = 0;
+    defer_fsync_config(200, 1);
+    defer(restore_fsync_window, &default_window);
+
+    fsync_worker_t workers[4];
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        workers[i].fd = fd;
+        workers[i].failures = 0;
+        pthread_create(&threads[i], NULL, fsync_worker, &workers[i]);
+    }
+    int failures = 0;
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        failures += workers[i].failures;
+    }
+    if (failures != 0) {
+        print_error("Group commit reported failures");
+        return;
+    }
+
+    // A bad descriptor in the batch only fails its own caller
+    if (defer_fsync_commit(-42) != -1 || errno != EBADF) {
+        print_error("Group commit did not report EBADF");
+        return;
+    }
+    print_success("Group commit fsync test completed");
+}
+
+void test_sendfile_transfer(void) {
+    printf("\n=== Testing Zero-Copy File Transfer ===\n");
+
+    char path[256];
+    snprintf(path, sizeof(path), "build%csendfile.bin", PATH_SEP);
+    if (write_pattern_file(path, 10000) != 0) {
+        print_error("Failed to create sendfile input file");
+        return;
+    }
+    defer(remove_file, path);
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        print_error("Failed to create socket pair");
+        return;
+    }
+    defer_close(&sv[0]);
+    defer_close(&sv[1]);
+
+    ssize_t sent = defer_sendfile(sv[0], path, 100, 5000);
+    if (sent != 5000) {
+        print_error("defer_sendfile sent the wrong number of bytes");
+        return;
+    }
+
+    unsigned char buf[5000];
+    size_t received = 0;
+    while (received < sizeof(buf)) {
+        ssize_t n = read(sv[1], buf + received, sizeof(buf) - received);
+        if (n <= 0) {
+            print_error("Failed to read transferred data");
+            return;
+        }
+        received += (size_t)n;
+    }
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        if (buf[i] != (unsigned char)((100 + i) % 251)) {
+            print_error("defer_sendfile transferred wrong data");
+            return;
+        }
+    }
+
+    if (defer_sendfile(sv[0], "build/does_not_exist.bin", 0, 0) != -1) {
+        print_error("defer_sendfile accepted a missing file");
+        return;
+    }
+    print_success("Zero-copy file transfer test completed");
+}
+
+static int count_entries(const char* path) {
+    DIR* dir = opendir(path);
+    if (!dir) {
+        return -1;
+    }
+    int count = 0;
+    while (readdir(dir)) {
+        count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+// Links its own temp files over a shared path; counts the failures
+static void* link_worker(void* arg) {
+    int* failures = (int*)arg;
+    for (int i = 0; i < 50; i++) {
+        int fd;
+        defer_tmpfile(&fd, "build");
+        if (fd < 0 || defer_tmpfile_link(fd, "build/test_tmpfile_shared.txt") != 0) {
+            (*failures)++;
+        }
+    }
+    return NULL;
+}
+
+void test_tmpfile_tmpdir(void) {
+    printf("\n=== Testing defer_tmpfile/defer_tmpdir ===\n");
+    const char* linked = "build/test_tmpfile_linked.txt";
+    remove(linked);
+    int before = count_entries("build");
+    {
+        int fd;
+        defer_tmpfile(&fd, "build");
+        if (fd < 0 || write(fd, "spill", 5) != 5) {
+            print_error("defer_tmpfile failed");
+            return;
+        }
+        if (count_entries("build") != before) {
+            print_error("Temp file is visible in the directory");
+            return;
+        }
+        if (defer_tmpfile_link(fd, linked) != 0 && errno != ENOENT && errno != ENOSYS) {
+            print_error("defer_tmpfile_link failed");
+            return;
+        }
+    }
+    FILE* file = fopen(linked, "r");
+    if (file) {
+        char buf[8] = {0};
+        size_t n = fread(buf, 1, sizeof(buf) - 1, file);
+        fclose(file);
+        remove(linked);
+        if (n != 5 || strcmp(buf, "spill") != 0) {
+            print_error("Linked temp file has the wrong contents");
+            return;
+        }
+    }
+    if (count_entries("build") != before) {
+        print_error("Temp file left an entry behind");
+        return;
+    }
+
+    // A file at a guessable temp name is left alone, and concurrent links
+    // over one path neither fail nor leave temp names behind
+    char decoy[PATH_MAX];
+    snprintf(decoy, sizeof(decoy), "build/test_tmpfile_shared.txt.%ld.tmp", (long)getpid());
+    FILE* owned = fopen(decoy, "w");
+    if (owned) {
+        fclose(owned);
+    }
+    int probe;
+    defer_tmpfile(&probe, "build");
+    if (probe >= 0 && defer_tmpfile_link(probe, "build/test_tmpfile_shared.txt") == 0) {
+        pthread_t threads[4];
+        int failures[4] = {0};
+        for (int i = 0; i < 4; i++) {
+            pthread_create(&threads[i], NULL, link_worker, &failures[i]);
+        }
+        for (int i = 0; i < 4; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        int entries = count_entries("build");
+        remove("build/test_tmpfile_shared.txt");
+        if (failures[0] + failures[1] + failures[2] + failures[3] != 0) {
+            print_error("Concurrent defer_tmpfile_link calls failed");
+            return;
+        }
+        if (entries != before + 2) {
+            print_error("Concurrent defer_tmpfile_link left temp names behind");
+            return;
+        }
+    }
+    if (access(decoy, F_OK) != 0) {
+        print_error("defer_tmpfile_link removed a file it did not create");
+        return;
+    }
+    remove(decoy);
+
+    char path[PATH_MAX];
+    {
+        defer_tmpdir_t dir;
+        defer_tmpdir(&dir, "build");
+        if (dir.fd < 0) {
+            print_error("defer_tmpdir failed");
+            return;
+        }
+        strcpy(path, dir.path);
+        // A small tree, plus a symlink that must not be followed out of it
+        if (mkdirat(dir.fd, "a", 0700) != 0 || mkdirat(dir.fd, "a/b", 0700) != 0 ||
+            symlinkat("..", dir.fd, "a/up") != 0) {
+            print_error("Could not populate the temp directory");
+            return;
+        }
+        const char* files[] = { "top.dat", "a/one.dat", "a/b/two.dat" };
+        for (int i = 0; i < 3; i++) {
+            int fd = openat(dir.fd, files[i], O_WRONLY | O_CREAT, 0600);
+            if (fd < 0) {
+                print_error("Could not create a file in the temp directory");
+                return;
+            }
+            close(fd);
+        }
+    }
+    struct stat st;
+    if (stat(path, &st) == 0 || errno != ENOENT || count_entries("build") != before) {
+        print_error("Temp directory was not removed");
+        return;
+    }
+    print_success("Temp file and temp directory test completed");
+}
+
+#else
+
+void test_streaming_reader(void) {
+    printf("Streaming reader test skipped (POSIX only)\n");
+}
+
+void test_direct_reader(void) {
+    printf("O_DIRECT reader test skipped (POSIX only)\n");
+}
+
+void test_buffered_writer(void) {
+    printf("Buffered writer test skipped (POSIX only)\n");
+}
+
+void test_group_fsync(void) {
+    printf("Group commit fsync test skipped (POSIX only)\n");
+}
+
+void test_sendfile_transfer(void) {
+    printf("Zero-copy file transfer test skipped (POSIX only)\n");
+}
+
+void test_tmpfile_tmpdir(void) {
+    printf("Temp file test skipped (POSIX only)\n");
+}
+
+#endif
@@ -207,4 +207,137 @@ void test_nested_scope_allocation(void) {
     }
 
     print_success("Nested scope allocation test completed");
-} 
\ No newline at end of file
+} 
+
+#ifndef _WIN32
+static int purge_calls = 0;
+
+static void count_purge(void* ctx) {
+    (*(int*)ctx)++;
+}
+
+static void load_phase(void) {
+    defer_mem_scope("test.load");
+    char* a = defer_mem_malloc(1000);
+    char* b = defer_mem_malloc(3000);
+    defer_mem_free(a);
+    defer_mem_free(b);
+    char* c = defer_mem_malloc(500);
+    defer_mem_free(c);
+}
+
+void test_mem_scope(void) {
+    printf("\n=== Testing defer_mem_scope ===\n");
+    defer_mem_set_purge(count_purge, &purge_calls);
+
+    {
+        defer_mem_scope_trim("test.outer", 4000);
+        char* kept = defer_mem_malloc(100);
+        defer_mem_free(kept);
+        load_phase();  // Peaks at 4000 bytes inside the nested phase
+        char* grown = defer_mem_realloc(NULL, 10);
+        grown = defer_mem_realloc(grown, 200);
+        if (!grown || defer_mem_peak() != 4000) {
+            print_error("Nested phase peak was not propagated");
+            return;
+        }
+        defer_mem_free(grown);
+        if (purge_calls != 0) {
+            print_error("Purge ran before the phase ended");
+            return;
+        }
+    }
+    if (purge_calls != 1 || defer_mem_peak() != -1) {
+        print_error("Phase over its trim threshold did not purge");
+        return;
+    }
+
+    // The report has one line per phase with its peak
+    FILE* out = tmpfile();
+    if (!out) {
+        print_error("tmpfile failed");
+        return;
+    }
+    defer_fclose(out);
+    defer_mem_report(out);
+    rewind(out);
+    char line[256];
+    int outer_line = 0, load_line = 0;
+    for (int n = 0; fgets(line, sizeof(line), out); n++) {
+        if (strncmp(line, "test.outer ", 11) == 0) {
+            outer_line = n;
+            if (strstr(line, " 4000 ") == NULL) {
+                print_error("Report has the wrong peak for the outer phase");
+                return;
+            }
+        } else if (strncmp(line, "test.load ", 10) == 0) {
+            load_line = n;
+        }
+    }
+    if (outer_line == 0 || load_line == 0) {
+        print_error("Report is missing a phase");
+        return;
+    }
+    defer_mem_set_purge(NULL, NULL);
+    print_success("Memory scope test completed");
+}
+
+void test_alloc_helpers(void) {
+    printf("\n=== Testing defer_alloc_aligned/defer_alloc_huge ===\n");
+
+    defer_alloc_t aligned;
+    {
+        char* buffer = defer_alloc_aligned(&aligned, 4096, 1000);
+        if (!buffer || (uintptr_t)buffer % 4096 != 0 || aligned.kind != DEFER_ALLOC_ALIGNED) {
+            print_error("Aligned allocation failed or is misaligned");
+            return;
+        }
+        memset(buffer, 0xab, 1000);
+    }
+    if (aligned.ptr != NULL || aligned.kind != DEFER_ALLOC_NONE) {
+        print_error("Aligned allocation was not released at scope exit");
+        return;
+    }
+    if (defer_alloc_aligned_enter(&aligned, 48, 64) != NULL || errno != EINVAL) {
+        print_error("Non power-of-two alignment was accepted");
+        return;
+    }
+
+    defer_alloc_t huge;
+    char* mapped;
+    size_t size = DEFER_HUGE_PAGE_SIZE + DEFER_HUGE_PAGE_SIZE / 2;
+    {
+        mapped = defer_alloc_huge(&huge, size);
+        if (!mapped || huge.size != 2 * (size_t)DEFER_HUGE_PAGE_SIZE ||
+            (huge.kind != DEFER_ALLOC_HUGETLB && huge.kind != DEFER_ALLOC_THP && huge.kind != DEFER_ALLOC_PAGES)) {
+            print_error("Huge allocation failed or recorded the wrong size");
+            return;
+        }
+        if (huge.kind != DEFER_ALLOC_PAGES && (uintptr_t)mapped % DEFER_HUGE_PAGE_SIZE != 0) {
+            print_error("Huge allocation is not huge-page aligned");
+            return;
+        }
+        if (mapped[size - 1] != 0) {
+            print_error("Huge allocation is not zeroed");
+            return;
+        }
+        memset(mapped, 1, huge.size);
+    }
+    // mincore fails with ENOMEM once the range is unmapped
+    unsigned char resident[2];
+    long page = sysconf(_SC_PAGESIZE);
+    if (huge.ptr != NULL || mincore(mapped, (size_t)page, resident) == 0 || errno != ENOMEM) {
+        print_error("Huge allocation was not unmapped at scope exit");
+        return;
+    }
+    print_success("Aligned and huge allocation test completed");
+}
+#else
+void test_mem_scope(void) {
+    printf("Memory scope test skipped (POSIX only)\n");
+}
+
+void test_alloc_helpers(void) {
+    printf("Aligned and huge allocation test skipped (POSIX only)\n");
+}
+#endif
@@ -0,0 +1,118 @@
+/**
+ * @file test_unwind.c
+ * @brief Error unwinding tests for defer_try/defer_throw
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_common.h"
+#include "../defer.h"
+
+typedef struct {
+    char order[16];
+    int count;
+} unwind_log_t;
+
+typedef struct {
+    unwind_log_t* log;
+    char name;
+} unwind_entry_t;
+
+static void log_unwind(void* arg) {
+    unwind_entry_t* entry = (unwind_entry_t*)arg;
+    entry->log->order[entry->log->count++] = entry->name;
+}
+
+static int descend(unwind_log_t* log, int depth, int fail_at) {
+    unwind_entry_t entry = { log, (char)('a' + depth) };
+    defer_dynamic(log_unwind, &entry);
+    if (depth == fail_at) {
+        defer_throw(100 + depth);
+    }
+    return depth == 0 ? 0 : descend(log, depth - 1, fail_at);
+}
+
+static int return_from_try(void) {
+    defer_try {
+        return 1;  // Leaving through return still pops the frame
+    } defer_catch(err) {
+        return err;
+    }
+    return 0;
+}
+
+void test_try_throw(void) {
+    printf("\n=== Testing defer_try/defer_throw ===\n");
+
+    // Success path: dynamic defers run at scope exit like regular ones
+    unwind_log_t log = { {0}, 0 };
+    volatile int caught = 0;
+    defer_try {
+        descend(&log, 3, -1);
+    } defer_catch(err) {
+        caught = err;
+    }
+    if (caught != 0 || strcmp(log.order, "abcd") != 0) {
+        print_error("Dynamic defers did not run on the success path");
+        return;
+    }
+
+    // Throw from depth 1: frames d, c, b unwind newest first
+    memset(&log, 0, sizeof(log));
+    defer_try {
+        descend(&log, 3, 1);
+        print_error("defer_throw returned");
+        return;
+    } defer_catch(err) {
+        caught = err;
+    }
+    if (caught != 101 || strcmp(log.order, "bcd") != 0) {
+        print_error("Throw did not unwind dynamic defers in LIFO order");
+        return;
+    }
+
+    // Nested frames: the inner catch rethrows to the outer one, and
+    // defers registered outside the inner try run only at the outer catch
+    memset(&log, 0, sizeof(log));
+    volatile int inner_caught = 0;
+    caught = 0;
+    defer_try {
+        unwind_entry_t outer = { &log, 'x' };
+        defer_dynamic(log_unwind, &outer);
+        defer_try {
+            descend(&log, 0, 0);
+        } defer_catch(err) {
+            inner_caught = err;
+            defer_throw(err + 1);
+        }
+    } defer_catch(err) {
+        caught = err;
+    }
+    if (inner_caught != 100 || caught != 101 || strcmp(log.order, "ax") != 0) {
+        print_error("Nested defer_try frames unwound incorrectly");
+        return;
+    }
+    // break and continue end the try block only, not the loop around it
+    volatile int passes = 0;
+    for (int i = 0; i < 3; i++) {
+        defer_try {
+            if (i == 1) {
+                break;
+            }
+            continue;
+        } defer_catch(err) {
+            (void)err;
+        }
+        passes++;
+    }
+    if (passes != 3 || defer_try_top != NULL) {
+        print_error("break/continue inside defer_try escaped the block");
+        return;
+    }
+    if (return_from_try() != 1 || defer_try_top != NULL || defer_unwind_top != NULL) {
+        print_error("Unwind state leaked out of defer_try");
+        return;
+    }
+    print_success("defer_try/defer_throw test completed");
+}